@@ -0,0 +1,213 @@
+#pragma once
+
+#include <raylib.h>
+#include "common.h"
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+//NOTE: decodes asset files on its own threads: file reads, image decoding and font rasterization. Nothing touches gl here,
+// the owner takes the decoded results on the main thread and uploads them. Threads are started by the first request,
+// runs which never request anything (headless) don't start any.
+
+enum class AssetKind : u8 {
+    Texture,
+    Font
+};
+
+struct AssetRequest {
+    AssetKind   kind;
+    // slot of the asset in the owner's arrays, handed back with the result
+    u32         slot;
+    int         fontSize;
+    std::string filename;
+};
+
+struct DecodedAsset {
+    AssetKind   kind;
+    u32         slot;
+    // false when the file couldn't be read or decoded, nothing else is set
+    bool        ok;
+    // texture pixels or font atlas
+    Image       image;
+    GlyphInfo * glyphs;
+    Rectangle * recs;
+    int         glyphsNum;
+    int         fontSize;
+    int         glyphPadding;
+};
+
+class AssetLoader {
+public:
+    // same glyph range as LoadFontEx(filename, size, nullptr, 256)
+    static constexpr int FONT_GLYPHS_NUM = 256;
+    static constexpr int FONT_GLYPH_PADDING = 4;
+    static constexpr u32 MAX_THREADS = 4;
+
+    void Request(const AssetRequest &request);
+    // moves the results decoded so far to the end of out
+    void TakeDecoded(std::vector<DecodedAsset> &out);
+    // joins the threads, requests which aren't decoded yet are dropped
+    void Stop();
+
+    // frees the cpu side of a result which won't be uploaded
+    static void Release(DecodedAsset &asset);
+
+    AssetLoader() = default;
+    ~AssetLoader() { Stop(); }
+
+    AssetLoader(const AssetLoader &other) = delete;
+    AssetLoader &operator=(const AssetLoader &other) = delete;
+
+private:
+    void Start();
+    void WorkerLoop();
+    static DecodedAsset Decode(const AssetRequest &request);
+
+    std::vector<std::thread>    m_threads;
+    std::mutex                  m_mutex;
+    std::condition_variable     m_wake;
+    // served in request order, m_nextRequest is the first one not picked by a thread
+    std::vector<AssetRequest>   m_requests;
+    size_t                      m_nextRequest = 0;
+    std::vector<DecodedAsset>   m_decoded;
+    bool                        m_running = false;
+};
+
+void AssetLoader::Request(const AssetRequest &request) {
+    if (m_threads.empty()) {
+        Start();
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_requests.push_back(request);
+    }
+    m_wake.notify_one();
+}
+
+void AssetLoader::TakeDecoded(std::vector<DecodedAsset> &out) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    out.insert(out.end(), m_decoded.begin(), m_decoded.end());
+    m_decoded.clear();
+}
+
+void AssetLoader::Start() {
+    // decoding is io and memory bound, a few threads are enough and leave the cores to the job system
+    u32 hardwareThreads = std::thread::hardware_concurrency();
+    u32 threadsNum = std::max(1u, std::min(MAX_THREADS, hardwareThreads / 2));
+
+    m_running = true;
+    m_threads.reserve(threadsNum);
+    for (u32 i = 0; i < threadsNum; ++i) {
+        m_threads.emplace_back(&AssetLoader::WorkerLoop, this);
+    }
+}
+
+void AssetLoader::Stop() {
+    if (m_threads.empty()) {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_running = false;
+    }
+    m_wake.notify_all();
+
+    for (auto &thread : m_threads) {
+        thread.join();
+    }
+    m_threads.clear();
+
+    for (auto &asset : m_decoded) {
+        Release(asset);
+    }
+    m_decoded.clear();
+    m_requests.clear();
+    m_nextRequest = 0;
+}
+
+void AssetLoader::WorkerLoop() {
+    while (true) {
+        AssetRequest request;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_wake.wait(lock, [this]() { return !m_running || m_nextRequest < m_requests.size(); });
+            if (!m_running) {
+                break;
+            }
+
+            request = m_requests[m_nextRequest++];
+        }
+
+        DecodedAsset asset = Decode(request);
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_running) {
+            Release(asset);
+            break;
+        }
+        m_decoded.push_back(asset);
+    }
+}
+
+DecodedAsset AssetLoader::Decode(const AssetRequest &request) {
+    DecodedAsset asset = {};
+    asset.kind = request.kind;
+    asset.slot = request.slot;
+
+    switch (request.kind) {
+    case AssetKind::Texture:
+        asset.image = LoadImage(request.filename.c_str());
+        asset.ok = asset.image.data != nullptr;
+        break;
+    case AssetKind::Font: {
+        int dataSize = 0;
+        unsigned char *data = LoadFileData(request.filename.c_str(), &dataSize);
+        if (!data) {
+            break;
+        }
+
+        // what LoadFontFromMemory does, minus the texture upload
+        asset.glyphs = LoadFontData(data, dataSize, request.fontSize, nullptr, FONT_GLYPHS_NUM, FONT_DEFAULT);
+        UnloadFileData(data);
+        if (!asset.glyphs) {
+            break;
+        }
+
+        asset.glyphsNum = FONT_GLYPHS_NUM;
+        asset.fontSize = request.fontSize;
+        asset.glyphPadding = FONT_GLYPH_PADDING;
+        asset.image = GenImageFontAtlas(asset.glyphs, &asset.recs, asset.glyphsNum, asset.fontSize, asset.glyphPadding, 0);
+        asset.ok = asset.image.data != nullptr;
+        break;
+    }
+    }
+
+    if (!asset.ok) {
+        TraceLog(LOG_WARNING, "ASSETS: Failed to decode %s", request.filename.c_str());
+        Release(asset);
+    }
+
+    return asset;
+}
+
+void AssetLoader::Release(DecodedAsset &asset) {
+    if (asset.image.data) {
+        UnloadImage(asset.image);
+        asset.image = {};
+    }
+
+    if (asset.glyphs) {
+        UnloadFontData(asset.glyphs, asset.glyphsNum);
+        asset.glyphs = nullptr;
+    }
+
+    if (asset.recs) {
+        MemFree(asset.recs);
+        asset.recs = nullptr;
+    }
+}
@@ -0,0 +1,346 @@
+#include <raylib.h>
+#include <stdio.h>
+#include <vector>
+#include "common.h"
+
+// Offline sprite atlas packer. Reads the sprite manifest, cuts every sprite out of its source image,
+// packs them into one power of two atlas and writes the atlas png plus the sprite table header the game includes.
+// Rerun it whenever the manifest or a source image changes.
+//
+// usage: AtlasPacker [manifest] [atlas png] [sprite table header]
+
+namespace packer {
+
+static constexpr int MAX_ATLAS_SIZE = 4096;
+// every sprite is surrounded by a copy of its border pixels, sampling never reads a neighbour sprite
+static constexpr int PADDING = 2;
+
+struct Sprite {
+    char        name[64];
+    char        source[128];
+    int         x, y, width, height;
+    // 0 keeps the source size, otherwise the sprite is downscaled to fit maxSize x maxSize
+    int         maxSize;
+    Image       image;
+    // position in the atlas, padding excluded
+    int         atlasX, atlasY;
+};
+
+struct SkylineNode {
+    int x, y, width;
+};
+
+static
+bool ParseManifest(const char *path, std::vector<Sprite> &sprites) {
+    FILE *file = fopen(path, "r");
+    if (!file) {
+        fprintf(stderr, "can't open %s\n", path);
+        return false;
+    }
+
+    char line[512];
+    int lineIndex = 0;
+    while (fgets(line, sizeof(line), file)) {
+        lineIndex++;
+        if (line[0] == '#' || line[0] == '\n' || line[0] == '\r') {
+            continue;
+        }
+
+        Sprite sprite = {};
+        int fields = sscanf(line, "%63s %127s %d %d %d %d %d", sprite.name, sprite.source,
+            &sprite.x, &sprite.y, &sprite.width, &sprite.height, &sprite.maxSize);
+        if (fields < 6) {
+            fprintf(stderr, "%s:%d: expected name source x y width height [max size]\n", path, lineIndex);
+            fclose(file);
+            return false;
+        }
+
+        sprites.push_back(sprite);
+    }
+
+    fclose(file);
+
+    return !sprites.empty();
+}
+
+// area average, keeps thin features of big sources which nearest neighbour would drop
+static
+Image Downscale(const Image &source, int width, int height) {
+    Image result = GenImageColor(width, height, BLANK);
+    const u8 *src = static_cast<const u8 *>(source.data);
+    u8 *dst = static_cast<u8 *>(result.data);
+
+    for (int y = 0; y < height; ++y) {
+        int y0 = (y * source.height) / height;
+        int y1 = std::max(y0 + 1, ((y + 1) * source.height) / height);
+        for (int x = 0; x < width; ++x) {
+            int x0 = (x * source.width) / width;
+            int x1 = std::max(x0 + 1, ((x + 1) * source.width) / width);
+
+            u32 sum[4] = {};
+            for (int sy = y0; sy < y1; ++sy) {
+                for (int sx = x0; sx < x1; ++sx) {
+                    const u8 *pixel = src + (sy * source.width + sx) * 4;
+                    for (int c = 0; c < 4; ++c) {
+                        sum[c] += pixel[c];
+                    }
+                }
+            }
+
+            u32 count = (u32)((y1 - y0) * (x1 - x0));
+            u8 *pixel = dst + (y * width + x) * 4;
+            for (int c = 0; c < 4; ++c) {
+                pixel[c] = static_cast<u8>((sum[c] + count / 2) / count);
+            }
+        }
+    }
+
+    return result;
+}
+
+static
+bool LoadSprite(const char *manifestDir, Sprite &sprite) {
+    Image source = LoadImage(TextFormat("%s/%s", manifestDir, sprite.source));
+    if (!source.data) {
+        return false;
+    }
+    ImageFormat(&source, PIXELFORMAT_UNCOMPRESSED_R8G8B8A8);
+
+    if (sprite.width == 0 || sprite.height == 0) {
+        sprite.x = 0;
+        sprite.y = 0;
+        sprite.width = source.width;
+        sprite.height = source.height;
+    }
+
+    if (sprite.x < 0 || sprite.y < 0 || sprite.x + sprite.width > source.width || sprite.y + sprite.height > source.height) {
+        fprintf(stderr, "%s: rect is outside of %s\n", sprite.name, sprite.source);
+        UnloadImage(source);
+        return false;
+    }
+
+    sprite.image = ImageFromImage(source, Rectangle{ (f32)sprite.x, (f32)sprite.y, (f32)sprite.width, (f32)sprite.height });
+    UnloadImage(source);
+
+    int longest = std::max(sprite.width, sprite.height);
+    if (sprite.maxSize > 0 && longest > sprite.maxSize) {
+        int width = std::max(1, (sprite.width * sprite.maxSize) / longest);
+        int height = std::max(1, (sprite.height * sprite.maxSize) / longest);
+        Image scaled = Downscale(sprite.image, width, height);
+        UnloadImage(sprite.image);
+        sprite.image = scaled;
+    }
+
+    return true;
+}
+
+// bottom left skyline, the lowest position wins and ties go to the leftmost one
+static
+bool Pack(std::vector<Sprite> &sprites, const std::vector<int> &order, int atlasWidth, int atlasHeight) {
+    std::vector<SkylineNode> skyline = { { 0, 0, atlasWidth } };
+
+    for (int spriteIndex : order) {
+        Sprite &sprite = sprites[spriteIndex];
+        int width = sprite.image.width + PADDING * 2;
+        int height = sprite.image.height + PADDING * 2;
+
+        int bestNode = -1;
+        int bestX = 0;
+        int bestY = MAX_ATLAS_SIZE + 1;
+        for (int i = 0; i < (int)skyline.size(); ++i) {
+            int x = skyline[i].x;
+            if (x + width > atlasWidth) {
+                break;
+            }
+
+            // the sprite rests on the highest node it spans
+            int y = 0;
+            int covered = 0;
+            for (int j = i; covered < width; ++j) {
+                y = std::max(y, skyline[j].y);
+                covered += skyline[j].width;
+            }
+
+            if (y + height <= atlasHeight && y < bestY) {
+                bestNode = i;
+                bestX = x;
+                bestY = y;
+            }
+        }
+
+        if (bestNode < 0) {
+            return false;
+        }
+
+        sprite.atlasX = bestX + PADDING;
+        sprite.atlasY = bestY + PADDING;
+
+        skyline.insert(skyline.begin() + bestNode, SkylineNode{ bestX, bestY + height, width });
+        // trim the nodes the sprite now covers
+        for (int i = bestNode + 1; i < (int)skyline.size();) {
+            int prevEnd = skyline[i - 1].x + skyline[i - 1].width;
+            if (skyline[i].x >= prevEnd) {
+                break;
+            }
+
+            int overlap = prevEnd - skyline[i].x;
+            if (overlap >= skyline[i].width) {
+                skyline.erase(skyline.begin() + i);
+                continue;
+            }
+
+            skyline[i].x += overlap;
+            skyline[i].width -= overlap;
+            break;
+        }
+
+        for (int i = 0; i + 1 < (int)skyline.size();) {
+            if (skyline[i].y == skyline[i + 1].y) {
+                skyline[i].width += skyline[i + 1].width;
+                skyline.erase(skyline.begin() + i + 1);
+                continue;
+            }
+            ++i;
+        }
+    }
+
+    return true;
+}
+
+static
+void Blit(Image &atlas, const Sprite &sprite) {
+    u8 *dst = static_cast<u8 *>(atlas.data);
+    const u8 *src = static_cast<const u8 *>(sprite.image.data);
+
+    // padding repeats the closest border pixel
+    for (int y = -PADDING; y < sprite.image.height + PADDING; ++y) {
+        int sy = std::min(std::max(y, 0), sprite.image.height - 1);
+        for (int x = -PADDING; x < sprite.image.width + PADDING; ++x) {
+            int sx = std::min(std::max(x, 0), sprite.image.width - 1);
+            memcpy(dst + ((sprite.atlasY + y) * atlas.width + sprite.atlasX + x) * 4, src + (sy * sprite.image.width + sx) * 4, 4);
+        }
+    }
+}
+
+static
+bool WriteHeader(const char *path, const char *atlasFile, const std::vector<Sprite> &sprites, int atlasWidth, int atlasHeight) {
+    FILE *file = fopen(path, "w");
+    if (!file) {
+        fprintf(stderr, "can't write %s\n", path);
+        return false;
+    }
+
+    fprintf(file, "#pragma once\n\n");
+    fprintf(file, "// generated by AtlasPacker from assets/atlas.txt, don't edit\n\n");
+    fprintf(file, "namespace breakout {\n\n");
+    fprintf(file, "enum class SpriteId : u16 {\n");
+    for (const auto &sprite : sprites) {
+        fprintf(file, "    %s,\n", sprite.name);
+    }
+    fprintf(file, "    Count\n};\n\n");
+
+    fprintf(file, "static constexpr const char *SPRITE_ATLAS_FILE = \"%s\";\n", atlasFile);
+    fprintf(file, "static constexpr int SPRITE_ATLAS_WIDTH = %d;\n", atlasWidth);
+    fprintf(file, "static constexpr int SPRITE_ATLAS_HEIGHT = %d;\n\n", atlasHeight);
+
+    fprintf(file, "static constexpr Rectangle SPRITE_RECTS[] = {\n");
+    for (const auto &sprite : sprites) {
+        fprintf(file, "    { %d, %d, %d, %d },\n", sprite.atlasX, sprite.atlasY, sprite.image.width, sprite.image.height);
+    }
+    fprintf(file, "};\n\n");
+
+    fprintf(file, "static_assert(sizeof(SPRITE_RECTS) / sizeof(SPRITE_RECTS[0]) == static_cast<size_t>(SpriteId::Count), \"Sprite table is out of date\");\n\n");
+    fprintf(file, "constexpr Rectangle GetSpriteRect(SpriteId id) {\n");
+    fprintf(file, "    return SPRITE_RECTS[static_cast<int>(id)];\n");
+    fprintf(file, "}\n\n");
+    fprintf(file, "}\n");
+
+    fclose(file);
+
+    return true;
+}
+
+}
+
+int main(int argc, char **argv) {
+    using namespace packer;
+
+    const char *manifestPath = argc > 1 ? argv[1] : "assets/atlas.txt";
+    const char *atlasPath = argc > 2 ? argv[2] : "assets/atlas.png";
+    const char *headerPath = argc > 3 ? argv[3] : "src/sprite_atlas.h";
+
+    SetTraceLogLevel(LOG_WARNING);
+
+    std::vector<Sprite> sprites;
+    if (!ParseManifest(manifestPath, sprites)) {
+        return 1;
+    }
+
+    std::string manifestDir = GetDirectoryPath(manifestPath);
+    for (auto &sprite : sprites) {
+        if (!LoadSprite(manifestDir.c_str(), sprite)) {
+            fprintf(stderr, "can't load sprite %s from %s\n", sprite.name, sprite.source);
+            return 1;
+        }
+    }
+
+    // tallest first, the manifest order breaks ties so the output is stable
+    std::vector<int> order(sprites.size());
+    for (int i = 0; i < (int)order.size(); ++i) {
+        order[i] = i;
+    }
+    std::stable_sort(order.begin(), order.end(), [&sprites](int a, int b) {
+        if (sprites[a].image.height != sprites[b].image.height) {
+            return sprites[a].image.height > sprites[b].image.height;
+        }
+        return sprites[a].image.width > sprites[b].image.width;
+    });
+
+    // smallest power of two area first, wide before tall
+    int atlasWidth = 0;
+    int atlasHeight = 0;
+    for (int area = 64 * 64; area <= MAX_ATLAS_SIZE * MAX_ATLAS_SIZE && atlasWidth == 0; area *= 2) {
+        for (int width = MAX_ATLAS_SIZE; width >= 64; width /= 2) {
+            int height = area / width;
+            if (height < 64 || height > MAX_ATLAS_SIZE) {
+                continue;
+            }
+
+            if (Pack(sprites, order, width, height)) {
+                atlasWidth = width;
+                atlasHeight = height;
+                break;
+            }
+        }
+    }
+
+    if (atlasWidth == 0) {
+        fprintf(stderr, "sprites don't fit in %dx%d\n", MAX_ATLAS_SIZE, MAX_ATLAS_SIZE);
+        return 1;
+    }
+
+    Image atlas = GenImageColor(atlasWidth, atlasHeight, BLANK);
+    for (const auto &sprite : sprites) {
+        Blit(atlas, sprite);
+    }
+
+    if (!ExportImage(atlas, atlasPath)) {
+        fprintf(stderr, "can't write %s\n", atlasPath);
+        return 1;
+    }
+
+    // the game loads the atlas relative to its working directory
+    std::string atlasFile = std::string("assets/") + GetFileName(atlasPath);
+    if (!WriteHeader(headerPath, atlasFile.c_str(), sprites, atlasWidth, atlasHeight)) {
+        return 1;
+    }
+
+    printf("%d sprites packed into %dx%d\n", (int)sprites.size(), atlasWidth, atlasHeight);
+
+    for (auto &sprite : sprites) {
+        UnloadImage(sprite.image);
+    }
+    UnloadImage(atlas);
+
+    return 0;
+}
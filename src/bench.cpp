@@ -0,0 +1,572 @@
+#include <raylib.h>
+#include <stdio.h>
+#include <chrono>
+#include "common.h"
+#include "game.h"
+#include "heap_tracking.h"
+
+// Headless throughput benchmark. Runs the gameplay update flat out with scripted input:
+// the paddle follows the ball, the scene is rebuilt whenever the round ends.
+// With --replay a session recorded by the game is re-simulated flat out instead, its checksum must match.
+// With --stress generated scenarios of N balls, M aliens and a WxH random map are run and the step cost per
+// entity count is written as CSV, to find where the collision, tick and draw submission paths stop scaling.
+// The level run ends with a ball faster than the sweep threshold, the exit code is 1 if it went through a block.
+//
+// usage: BreakoutBench [ticks per level]
+//        BreakoutBench --replay <file.brpl>
+//        BreakoutBench --stress [ticks per scenario] [out.csv] [job system workers]
+
+namespace bench {
+
+struct LevelSize {
+    int width;
+    int height;
+};
+
+struct Result {
+    LevelSize   size;
+    int         blocks;
+    u64         ticks;
+    // blocks inside the world when the round starts, the rows above come in as the view scrolls
+    int         blocksInView;
+    u64         entityTicks;
+    u64         collisionTests;
+    // heap allocations made by ticks of a running round, rebuilding the scene is not counted
+    u64         heapAllocations;
+    size_t      objectsHighWater;
+    f64         seconds;
+    // average time to build the scene from the level file
+    f64         loadSeconds;
+};
+
+// every column is inside the world, wider levels get narrower tiles. Like in the game the rows above the view
+// scroll in once the ones below are cleared
+static
+Vector2 GetFieldTileSize(int width) {
+    using namespace breakout;
+
+    const Rectangle &world = g_gameState.worldDim;
+    f32 fieldWidth = (world.width - world.x) - MAP_OFFSET.x * 2.0f;
+    f32 tileWidth = floorf((fieldWidth + Map::PADDING) / width - Map::PADDING);
+    assert(tileWidth >= 1.0f && "Level is too wide for the world");
+
+    return Vector2{ std::min(tileWidth, 48.0f), 24.0f };
+}
+
+static
+int CountBlocksInView() {
+    using namespace breakout;
+
+    const Rectangle &world = g_gameState.worldDim;
+    const Map *map = g_gameState.map;
+    Vector2 tileSize = map->GetTileSize();
+
+    int blocksNum = 0;
+    for (int y = 0; y < map->GetHeight(); ++y) {
+        for (int x = 0; x < map->GetWidth(); ++x) {
+            Vector2 pos = map->GetTilePosition(x, y);
+            blocksNum += pos.x >= world.x && pos.x + tileSize.x <= world.width && pos.y >= world.y && pos.y + tileSize.y <= world.height;
+        }
+    }
+
+    return blocksNum;
+}
+
+static
+void StartRound(const breakout::LevelData &level) {
+    breakout::InitScene(level);
+    breakout::g_gameState.gameplayState = breakout::GameplayState::RunGame;
+}
+
+static
+void ScriptInput() {
+    using namespace breakout;
+
+    InputState &input = g_gameState.input;
+    input.ReleaseAll();
+
+    BallComponent *ballComp = g_gameState.ball->GetComponent<BallComponent>();
+    PlayerComponent *playerComp = g_gameState.player->GetComponent<PlayerComponent>();
+    if (!ballComp->IsLaunched()) {
+        input.SetKey(KEY_SPACE, true);
+        return;
+    }
+
+    f32 diff = ballComp->GetCenter().x - playerComp->GetCenter().x;
+    const f32 deadZone = 8.0f;
+    if (diff < -deadZone) {
+        input.SetKey(KEY_LEFT, true);
+    }
+    else if (diff > deadZone) {
+        input.SetKey(KEY_RIGHT, true);
+    }
+    input.SetKey(KEY_LEFT_SHIFT, true);
+}
+
+static
+Result Run(LevelSize size, u64 ticks) {
+    using namespace breakout;
+
+    // levels go through the file format, the loader runs on the same bytes the game maps
+    std::vector<u8> tiles(size.width * size.height, 1);
+    std::vector<u8> file;
+    EncodeLevel(MakeLevel(tiles.data(), size.width, size.height, GetFieldTileSize(size.width)), file);
+
+    LevelData level;
+    bool parsed = ParseLevel(file.data(), file.size(), level);
+    assert(parsed);
+    (void)parsed;
+
+    Result result = {};
+    result.size = size;
+
+    f64 loadSeconds = 0.0;
+    u64 loadsNum = 0;
+    auto timedStartRound = [&]() {
+        auto loadStart = std::chrono::steady_clock::now();
+        StartRound(level);
+        loadSeconds += std::chrono::duration<f64>(std::chrono::steady_clock::now() - loadStart).count();
+        loadsNum++;
+    };
+
+    timedStartRound();
+    result.blocks = g_gameState.map->GetBlocksNum();
+    result.blocksInView = CountBlocksInView();
+
+    auto start = std::chrono::steady_clock::now();
+
+    for (u64 tick = 0; tick < ticks; ++tick) {
+        if (g_gameState.gameplayState != GameplayState::RunGame) {
+            DestroyScene();
+            timedStartRound();
+        }
+
+        ScriptInput();
+
+        int objectsNum = g_gameState.goMgr.GetObjectsNum();
+
+        bool exitRequested = false;
+        Update(TIME_STEP, exitRequested);
+        if (g_gameState.gameplayState == GameplayState::RunGame) {
+            result.heapAllocations += g_gameState.stepHeapAllocations;
+        }
+
+        result.entityTicks += objectsNum;
+        result.collisionTests += g_gameState.collisionMgr.GetTestsNum();
+    }
+
+    auto end = std::chrono::steady_clock::now();
+
+    result.ticks = ticks;
+    result.seconds = std::chrono::duration<f64>(end - start).count();
+    result.objectsHighWater = g_gameState.goMgr.GetMemoryStats().highWater;
+    result.loadSeconds = loadSeconds / (f64)loadsNum;
+
+    DestroyScene();
+
+    return result;
+}
+
+struct FastBallResult {
+    u64         ticks;
+    // steps the ball moved by more than the sweep threshold
+    u64         sweptSteps;
+    u64         blocksHit;
+    // straight moves which went through a block without hitting it
+    u64         tunnels;
+};
+
+//NOTE: the ball kept at FAST_BALL_SCALE times the launch speed, every step moves it further than the sweep threshold.
+// A step which didn't change the velocity ended without a bounce, the ball's move from the previous center must not
+// touch a block which is still there
+static constexpr f32 FAST_BALL_SCALE = 4.0f;
+
+static
+FastBallResult RunFastBall(LevelSize size, u64 ticks) {
+    using namespace breakout;
+
+    std::vector<u8> tiles(size.width * size.height, 1);
+    std::vector<u8> file;
+    EncodeLevel(MakeLevel(tiles.data(), size.width, size.height, GetFieldTileSize(size.width)), file);
+
+    LevelData level;
+    bool parsed = ParseLevel(file.data(), file.size(), level);
+    assert(parsed);
+    (void)parsed;
+
+    const f32 speed = Vector2Length(BallComponent::INIT_VELOCITY) * FAST_BALL_SCALE;
+    const f32 sweepThreshold = BallComponent::RADIUS * CollisionManager::SWEEP_THRESHOLD;
+
+    FastBallResult result = {};
+    StartRound(level);
+
+    for (u64 tick = 0; tick < ticks; ++tick) {
+        if (g_gameState.gameplayState != GameplayState::RunGame) {
+            DestroyScene();
+            StartRound(level);
+        }
+
+        ScriptInput();
+
+        BallComponent *ballComp = g_gameState.ball->GetComponent<BallComponent>();
+        Vector2 velocity = Vector2Zero();
+        if (ballComp->IsLaunched()) {
+            velocity = Vector2Scale(Vector2Normalize(ballComp->GetVelocity()), speed);
+            ballComp->SetVelocity(velocity);
+        }
+        int hitScore = g_gameState.hitScore;
+
+        bool exitRequested = false;
+        Update(TIME_STEP, exitRequested);
+        if (g_gameState.gameplayState != GameplayState::RunGame || !ballComp->IsLaunched()) {
+            continue;
+        }
+
+        result.ticks++;
+        result.blocksHit += g_gameState.hitScore - hitScore;
+
+        Vector2 start = ballComp->GetPrevCenter();
+        Vector2 delta = Vector2Subtract(ballComp->GetCenter(), start);
+        result.sweptSteps += Vector2Length(delta) > sweepThreshold;
+        if (!Vector2Equals(ballComp->GetVelocity(), velocity)) {
+            continue;
+        }
+
+        Circle circle = { start, ballComp->GetRadius() };
+        g_gameState.goMgr.ForEachObject([&](GameObject *go) {
+            BlockComponent *blockComp = go->GetComponent<BlockComponent>();
+            if (!blockComp || go->IsQueuedForDestroy()) {
+                return;
+            }
+
+            AABB aabb = { blockComp->GetCenter(), Vector2Scale(blockComp->GetSize(), 0.5f) };
+            f32 toi = 0.0f;
+            Vector2 normal = {};
+            f32 depth = 0.0f;
+            result.tunnels += SweptCircleVsAABB(aabb, circle, delta, toi, normal, depth);
+        });
+    }
+
+    DestroyScene();
+
+    return result;
+}
+
+struct Scenario {
+    int         balls;
+    int         aliens;
+    LevelSize   size;
+};
+
+struct StressResult {
+    int         blocks;
+    // running round ticks, the steps ending a round and the rebuilds aren't measured
+    u64         ticks;
+    u64         rounds;
+    u64         entityTicks;
+    u64         collisionTests;
+    u64         drawItems;
+    f64         stepSeconds;
+    // profiler markers of the measured steps
+    f64         objectsSeconds;
+    f64         collisionSeconds;
+};
+
+//NOTE: the scenario's entities on top of the regular scene. Lost extra balls are destroyed by the game,
+// they are replaced before every step, fallen aliens are sent back in from the top
+struct ScenarioState {
+    std::vector<breakout::GameObjectHandle> balls;
+    std::vector<breakout::AlienComponent *> aliens;
+};
+
+static
+f32 RandomRange(f32 min, f32 max) {
+    return min + (max - min) * (f32)GetRandomValue(0, 10000) / 10000.0f;
+}
+
+static
+void SpawnScenarioBall(breakout::GameObjectHandle &handle) {
+    using namespace breakout;
+
+    const Rectangle &world = g_gameState.worldDim;
+    f32 speed = Vector2Length(g_gameState.ball->GetComponent<BallComponent>()->GetVelocity());
+    f32 angle = RandomRange(0.15f, 0.85f) * PI;
+    Vector2 center = { RandomRange(world.x + 64.0f, world.width - 64.0f), RandomRange(world.y + 64.0f, (world.y + world.height) * 0.5f) };
+
+    handle = SpawnBall(center, Vector2{ cosf(angle) * speed, -sinf(angle) * speed })->GetHandle();
+}
+
+static
+void SpawnScenarioAlien(breakout::AlienComponent *alien) {
+    using namespace breakout;
+
+    const Rectangle &world = g_gameState.worldDim;
+    alien->Spawn(Vector2{ RandomRange(world.x, world.width - AlienComponent::SIZE), world.y });
+}
+
+static
+void StartScenario(const Scenario &scenario, const breakout::LevelData &level, ScenarioState &state) {
+    using namespace breakout;
+
+    StartRound(level);
+
+    // the serving ball counts as one
+    state.balls.resize(std::max(scenario.balls - 1, 0));
+    for (GameObjectHandle &handle : state.balls) {
+        SpawnScenarioBall(handle);
+    }
+
+    // next to the portal's wave, the pool hands out the extra ones first
+    g_gameState.alienPool.Prewarm(g_gameState.goMgr, scenario.aliens, [](GameObject *go) {
+        go->AddComponent<AlienComponent>(0.0f, 0.0f, AlienComponent::SIZE, AlienComponent::SIZE, AlienComponent::RADIUS);
+    });
+
+    state.aliens.clear();
+    for (int i = 0; i < scenario.aliens; ++i) {
+        AlienComponent *alien = g_gameState.alienPool.Acquire();
+        assert(alien);
+        SpawnScenarioAlien(alien);
+        state.aliens.push_back(alien);
+    }
+}
+
+static
+void RefillScenario(ScenarioState &state) {
+    using namespace breakout;
+
+    for (GameObjectHandle &handle : state.balls) {
+        if (!g_gameState.goMgr.Get(handle)) {
+            SpawnScenarioBall(handle);
+        }
+    }
+
+    for (AlienComponent *alien : state.aliens) {
+        if (alien->Fell()) {
+            SpawnScenarioAlien(alien);
+        }
+    }
+}
+
+static
+StressResult RunScenario(const Scenario &scenario, u64 ticks) {
+    using namespace breakout;
+
+    // a quarter of the tiles is left empty, the ball sees gaps and rows like in a real level
+    std::vector<u8> tiles(scenario.size.width * scenario.size.height);
+    for (u8 &tile : tiles) {
+        tile = GetRandomValue(0, 3) != 0 ? 1 : 0;
+    }
+    LevelData level = MakeLevel(tiles.data(), scenario.size.width, scenario.size.height, GetFieldTileSize(scenario.size.width));
+
+    StressResult result = {};
+    ScenarioState state;
+    StartScenario(scenario, level, state);
+    result.blocks = g_gameState.map->GetBlocksNum();
+    result.rounds = 1;
+
+    for (u64 tick = 0; tick < ticks; ++tick) {
+        if (g_gameState.gameplayState != GameplayState::RunGame) {
+            DestroyScene();
+            StartScenario(scenario, level, state);
+            result.rounds++;
+        }
+
+        RefillScenario(state);
+        ScriptInput();
+
+        int objectsNum = g_gameState.goMgr.GetObjectsNum();
+
+        auto start = std::chrono::steady_clock::now();
+        bool exitRequested = false;
+        Update(TIME_STEP, exitRequested);
+        f64 seconds = std::chrono::duration<f64>(std::chrono::steady_clock::now() - start).count();
+
+#if PROFILER
+        Profiler::Instance().EndFrame();
+#endif
+
+        if (g_gameState.gameplayState != GameplayState::RunGame) {
+            continue;
+        }
+
+        result.ticks++;
+        result.stepSeconds += seconds;
+        result.entityTicks += objectsNum;
+        result.collisionTests += g_gameState.collisionMgr.GetTestsNum();
+        result.drawItems += DrawManager::Instance().GetItemsNum();
+
+#if PROFILER
+        const Profiler::MarkerStats *objects = Profiler::Instance().FindMarker("GameObjects");
+        const Profiler::MarkerStats *collisions = Profiler::Instance().FindMarker("Collisions");
+        result.objectsSeconds += objects ? objects->frameMs * 1e-3 : 0.0;
+        result.collisionSeconds += collisions ? collisions->frameMs * 1e-3 : 0.0;
+#endif
+    }
+
+    DestroyScene();
+
+    return result;
+}
+
+static
+int RunStress(u64 ticks, const char *csvPath) {
+    using namespace breakout;
+
+    FILE *csv = fopen(csvPath, "w");
+    if (!csv) {
+        fprintf(stderr, "Failed to write %s\n", csvPath);
+        return 1;
+    }
+
+    const int ballCounts[] = { 1, 4, 16, 64, 256 };
+    const int alienCounts[] = { 0, 32, 128 };
+    // the tall one streams, only the chunks around the view have blocks
+    const LevelSize sizes[] = { { 16, 8 }, { 64, 64 }, { 16, 1024 } };
+
+    const char *header = "balls,aliens,level,blocks,entities,ticks,rounds,step_us,objects_us,collisions_us,tests_per_step,draw_items_per_step\n";
+    fputs(header, csv);
+    fputs(header, stdout);
+
+    for (const LevelSize &size : sizes) {
+        for (int aliens : alienCounts) {
+            for (int balls : ballCounts) {
+                Scenario scenario = { balls, aliens, size };
+                StressResult result = RunScenario(scenario, ticks);
+
+                f64 ticksNum = (f64)std::max<u64>(result.ticks, 1);
+                char line[256];
+                snprintf(line, sizeof(line), "%d,%d,%dx%d,%d,%.1f,%llu,%llu,%.2f,%.2f,%.2f,%.1f,%.1f\n",
+                    balls, aliens, size.width, size.height, result.blocks, result.entityTicks / ticksNum,
+                    (unsigned long long)result.ticks, (unsigned long long)result.rounds,
+                    result.stepSeconds * 1e6 / ticksNum, result.objectsSeconds * 1e6 / ticksNum, result.collisionSeconds * 1e6 / ticksNum,
+                    result.collisionTests / ticksNum, result.drawItems / ticksNum);
+                fputs(line, csv);
+                fputs(line, stdout);
+            }
+        }
+    }
+
+    fclose(csv);
+
+    return 0;
+}
+
+// returns the process exit code, 1 if the replay didn't play out like the recorded session
+static
+int RunReplay(const char *path) {
+    using namespace breakout;
+
+    MappedFile file;
+    ReplayData replay;
+    if (!file.Open(path) || !ParseReplay(file.GetData(), file.GetSize(), replay)) {
+        fprintf(stderr, "%s is not a replay of this build (%d steps per second)\n", path, TARGET_FPS);
+        return 1;
+    }
+
+    // the world is laid out from the screen size
+    globals::appSettings.screenWidth = replay.screenSize.x;
+    globals::appSettings.screenHeight = replay.screenSize.y;
+
+    Initialize(replay.seed);
+
+    ReplayPlayer player;
+    player.Init(replay);
+
+    auto start = std::chrono::steady_clock::now();
+
+    bool exitRequested = false;
+    while (!exitRequested && player.NextTick(g_gameState.input, g_gameState.assetsReady)) {
+        Update(TIME_STEP, exitRequested);
+    }
+
+    f64 seconds = std::chrono::duration<f64>(std::chrono::steady_clock::now() - start).count();
+    f64 playedSeconds = player.GetTick() * (f64)TIME_STEP;
+    bool matches = player.GetTick() == replay.ticksNum && g_gameState.checksum == replay.checksum;
+
+    printf("%-10s %10s %12s %12s %12s %10s\n", "replay", "ticks", "played s", "replay ms", "speedup", "checksum");
+    printf("%-10s %10u %12.1f %12.2f %11.0fx %10s\n",
+        GetFileName(path), player.GetTick(), playedSeconds, seconds * 1e3, playedSeconds / std::max(seconds, 1e-9), matches ? "ok" : "MISMATCH");
+
+    if (g_gameState.map) {
+        DestroyScene();
+    }
+    JobSystem::Instance().Shutdown();
+
+    return matches ? 0 : 1;
+}
+
+}
+
+int main(int argc, char **argv) {
+    SetTraceLogLevel(LOG_WARNING);
+
+    globals::appSettings.name = "BreakoutBench";
+
+    if (argc > 2 && strcmp(argv[1], "--replay") == 0) {
+        return bench::RunReplay(argv[2]);
+    }
+
+    globals::appSettings.screenWidth = 1920;
+    globals::appSettings.screenHeight = 1080;
+
+    breakout::Initialize(1);
+
+    if (argc > 1 && strcmp(argv[1], "--stress") == 0) {
+        u64 ticks = argc > 2 ? strtoull(argv[2], nullptr, 10) : 2000;
+        // the same scenarios with another job system, 0 runs every job on the simulation thread
+        if (argc > 4) {
+            JobSystem::Instance().Shutdown();
+            JobSystem::Instance().Init(static_cast<u32>(strtoul(argv[4], nullptr, 10)));
+        }
+        int result = bench::RunStress(ticks, argc > 3 ? argv[3] : "stress.csv");
+        JobSystem::Instance().Shutdown();
+        return result;
+    }
+
+    u64 ticks = 20000;
+    if (argc > 1) {
+        ticks = strtoull(argv[1], nullptr, 10);
+    }
+
+    const bench::LevelSize sizes[] = {
+        { 9, 3 },
+        { 16, 8 },
+        { 32, 16 },
+        { 48, 32 },
+        { 64, 64 },
+        { 128, 128 },
+    };
+
+    printf("%-10s %8s %8s %10s %12s %14s %14s %12s %12s %10s\n", "level", "blocks", "in view", "ticks", "ticks/sec", "ns/entity", "tests/frame", "allocs/tick", "objects KB", "load us");
+
+    for (const auto &size : sizes) {
+        bench::Result result = bench::Run(size, ticks);
+
+        f64 ticksPerSec = (f64)result.ticks / result.seconds;
+        f64 nsPerEntity = (result.seconds * 1e9) / (f64)std::max<u64>(result.entityTicks, 1);
+        f64 testsPerFrame = (f64)result.collisionTests / (f64)result.ticks;
+        f64 allocsPerTick = (f64)result.heapAllocations / (f64)result.ticks;
+
+        char level[32];
+        snprintf(level, sizeof(level), "%dx%d", size.width, size.height);
+        printf("%-10s %8d %8d %10llu %12.0f %14.2f %14.2f %12.3f %12zu %10.1f\n",
+            level, result.blocks, result.blocksInView, (unsigned long long)result.ticks, ticksPerSec, nsPerEntity, testsPerFrame, allocsPerTick, result.objectsHighWater / 1024, result.loadSeconds * 1e6);
+    }
+
+    printf("\n%-10s %8s %10s %12s %10s %10s\n", "fast ball", "speed", "ticks", "swept", "hits", "tunnels");
+
+    u64 tunnels = 0;
+    for (const bench::LevelSize size : { bench::LevelSize{ 32, 16 }, bench::LevelSize{ 48, 32 } }) {
+        bench::FastBallResult result = bench::RunFastBall(size, ticks);
+        tunnels += result.tunnels;
+
+        char level[32];
+        snprintf(level, sizeof(level), "%dx%d", size.width, size.height);
+        printf("%-10s %7.0fx %10llu %12llu %10llu %10llu\n",
+            level, bench::FAST_BALL_SCALE, (unsigned long long)result.ticks, (unsigned long long)result.sweptSteps, (unsigned long long)result.blocksHit, (unsigned long long)result.tunnels);
+    }
+
+    JobSystem::Instance().Shutdown();
+
+    return tunnels == 0 ? 0 : 1;
+}
@@ -0,0 +1,259 @@
+#pragma once
+
+#include "common.h"
+#include "gamelib.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define COLLISION_SIMD_AVX2 1
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define COLLISION_SIMD_SSE2 1
+#elif defined(__ARM_NEON) || defined(_M_ARM64)
+#include <arm_neon.h>
+#define COLLISION_SIMD_NEON 1
+#endif
+
+//NOTE: circle vs many AABBs. Boxes are kept as SoA arrays of centers and half extents, the kernel tests
+// one circle against a group of COLLISION_SIMD_WIDTH boxes and compares squared distances, no sqrt.
+// The instruction set is picked at compile time (/arch:AVX2 or -mavx2 for the 8 wide path).
+
+namespace breakout {
+
+#if COLLISION_SIMD_AVX2
+static constexpr u32 COLLISION_SIMD_WIDTH = 8;
+#else
+static constexpr u32 COLLISION_SIMD_WIDTH = 4;
+#endif
+
+struct AABBSoA {
+    static constexpr size_t ALIGNMENT = 32;
+    // far away padding value, the squared distance to it still fits in a float
+    static constexpr f32 PADDING_CENTER = 1e18f;
+
+    f32 *           centerX = nullptr;
+    f32 *           centerY = nullptr;
+    f32 *           halfX = nullptr;
+    f32 *           halfY = nullptr;
+    u32             count = 0;
+    // multiple of COLLISION_SIMD_WIDTH, slots past count hold padding boxes
+    u32             capacity = 0;
+    MemoryArena     arena;
+
+    AABBSoA() = default;
+    ~AABBSoA() { arena.Free(); }
+
+    AABBSoA(const AABBSoA &other) = delete;
+    AABBSoA &operator=(const AABBSoA &other) = delete;
+
+    // bounds are (center x, center y, half width, half height), the layout used by the collision manager
+    void Add(Rectangle bounds);
+    void RemoveSwap(u32 index);
+    void Clear();
+
+    // number of groups covering count boxes
+    u32 GetGroupsNum() const { return (count + COLLISION_SIMD_WIDTH - 1) / COLLISION_SIMD_WIDTH; }
+
+private:
+    void Grow();
+    void SetPadding(u32 index);
+};
+
+struct AABBBatchHit {
+    // index of the first box hit, -1 when nothing is hit
+    int                 first = -1;
+    // hits in the group containing first, bit i is box groupStart + i
+    u32                 mask = 0;
+    u32                 groupStart = 0;
+    // boxes from begin up to the first hit, padding included
+    u32                 testsNum = 0;
+    CollisionManifold   manifold;
+};
+
+// hit mask of the COLLISION_SIMD_WIDTH boxes starting at groupStart, groupStart must be a multiple of the width
+inline u32 CircleVsAABBGroup(const AABBSoA &soa, u32 groupStart, Circle circle);
+
+// first box hit at or after begin, the manifold is computed by AABBvsCircle for that box only
+inline AABBBatchHit CircleVsAABBs(const AABBSoA &soa, u32 begin, Circle circle);
+
+inline
+void AABBSoA::Add(Rectangle bounds) {
+    if (count == capacity) {
+        Grow();
+    }
+
+    centerX[count] = bounds.x;
+    centerY[count] = bounds.y;
+    halfX[count] = bounds.width;
+    halfY[count] = bounds.height;
+    count++;
+}
+
+inline
+void AABBSoA::RemoveSwap(u32 index) {
+    assert(index < count);
+    u32 last = count - 1;
+    centerX[index] = centerX[last];
+    centerY[index] = centerY[last];
+    halfX[index] = halfX[last];
+    halfY[index] = halfY[last];
+    SetPadding(last);
+    count--;
+}
+
+inline
+void AABBSoA::Clear() {
+    centerX = centerY = halfX = halfY = nullptr;
+    count = 0;
+    capacity = 0;
+    arena.Clear();
+}
+
+inline
+void AABBSoA::Grow() {
+    if (arena.chunkSize == 0) {
+        arena.InitGrowable(64 * 1024);
+    }
+
+    // old arrays stay in the arena until Clear, growth is geometric so at most half of it is wasted
+    u32 newCapacity = std::max<u32>(capacity * 2, 64);
+    f32 *arrays[4];
+    for (auto &array : arrays) {
+        array = arena.PushAligned<f32>(newCapacity, ALIGNMENT);
+    }
+
+    if (count > 0) {
+        memcpy(arrays[0], centerX, count * sizeof(f32));
+        memcpy(arrays[1], centerY, count * sizeof(f32));
+        memcpy(arrays[2], halfX, count * sizeof(f32));
+        memcpy(arrays[3], halfY, count * sizeof(f32));
+    }
+
+    centerX = arrays[0];
+    centerY = arrays[1];
+    halfX = arrays[2];
+    halfY = arrays[3];
+    capacity = newCapacity;
+
+    for (u32 i = count; i < capacity; ++i) {
+        SetPadding(i);
+    }
+}
+
+inline
+void AABBSoA::SetPadding(u32 index) {
+    centerX[index] = PADDING_CENTER;
+    centerY[index] = PADDING_CENTER;
+    halfX[index] = 0.0f;
+    halfY[index] = 0.0f;
+}
+
+inline
+u32 CircleVsAABBGroup(const AABBSoA &soa, u32 groupStart, Circle circle) {
+    assert(groupStart % COLLISION_SIMD_WIDTH == 0 && groupStart < soa.capacity);
+
+    const f32 *bx = soa.centerX + groupStart;
+    const f32 *by = soa.centerY + groupStart;
+    const f32 *hx = soa.halfX + groupStart;
+    const f32 *hy = soa.halfY + groupStart;
+    const f32 radiusSq = circle.radius * circle.radius;
+
+#if COLLISION_SIMD_AVX2
+    __m256 cx = _mm256_set1_ps(circle.center.x);
+    __m256 cy = _mm256_set1_ps(circle.center.y);
+    __m256 halfX = _mm256_load_ps(hx);
+    __m256 halfY = _mm256_load_ps(hy);
+    __m256 zero = _mm256_setzero_ps();
+
+    // offset from the circle center to the closest point of the box
+    __m256 dx = _mm256_sub_ps(cx, _mm256_load_ps(bx));
+    __m256 dy = _mm256_sub_ps(cy, _mm256_load_ps(by));
+    __m256 ox = _mm256_sub_ps(_mm256_min_ps(_mm256_max_ps(dx, _mm256_sub_ps(zero, halfX)), halfX), dx);
+    __m256 oy = _mm256_sub_ps(_mm256_min_ps(_mm256_max_ps(dy, _mm256_sub_ps(zero, halfY)), halfY), dy);
+    __m256 distSq = _mm256_add_ps(_mm256_mul_ps(ox, ox), _mm256_mul_ps(oy, oy));
+
+    return (u32)_mm256_movemask_ps(_mm256_cmp_ps(distSq, _mm256_set1_ps(radiusSq), _CMP_LE_OQ));
+#elif COLLISION_SIMD_SSE2
+    __m128 cx = _mm_set1_ps(circle.center.x);
+    __m128 cy = _mm_set1_ps(circle.center.y);
+    __m128 halfX = _mm_load_ps(hx);
+    __m128 halfY = _mm_load_ps(hy);
+    __m128 zero = _mm_setzero_ps();
+
+    // offset from the circle center to the closest point of the box
+    __m128 dx = _mm_sub_ps(cx, _mm_load_ps(bx));
+    __m128 dy = _mm_sub_ps(cy, _mm_load_ps(by));
+    __m128 ox = _mm_sub_ps(_mm_min_ps(_mm_max_ps(dx, _mm_sub_ps(zero, halfX)), halfX), dx);
+    __m128 oy = _mm_sub_ps(_mm_min_ps(_mm_max_ps(dy, _mm_sub_ps(zero, halfY)), halfY), dy);
+    __m128 distSq = _mm_add_ps(_mm_mul_ps(ox, ox), _mm_mul_ps(oy, oy));
+
+    return (u32)_mm_movemask_ps(_mm_cmple_ps(distSq, _mm_set1_ps(radiusSq)));
+#elif COLLISION_SIMD_NEON
+    float32x4_t cx = vdupq_n_f32(circle.center.x);
+    float32x4_t cy = vdupq_n_f32(circle.center.y);
+    float32x4_t halfX = vld1q_f32(hx);
+    float32x4_t halfY = vld1q_f32(hy);
+
+    // offset from the circle center to the closest point of the box
+    float32x4_t dx = vsubq_f32(cx, vld1q_f32(bx));
+    float32x4_t dy = vsubq_f32(cy, vld1q_f32(by));
+    float32x4_t ox = vsubq_f32(vminq_f32(vmaxq_f32(dx, vnegq_f32(halfX)), halfX), dx);
+    float32x4_t oy = vsubq_f32(vminq_f32(vmaxq_f32(dy, vnegq_f32(halfY)), halfY), dy);
+    float32x4_t distSq = vaddq_f32(vmulq_f32(ox, ox), vmulq_f32(oy, oy));
+
+    uint32x4_t hits = vcleq_f32(distSq, vdupq_n_f32(radiusSq));
+    const uint32_t bitsData[4] = { 1, 2, 4, 8 };
+    uint32x4_t bits = vandq_u32(hits, vld1q_u32(bitsData));
+    uint32x2_t sum = vadd_u32(vget_low_u32(bits), vget_high_u32(bits));
+
+    return vget_lane_u32(vpadd_u32(sum, sum), 0);
+#else
+    u32 mask = 0;
+    for (u32 i = 0; i < COLLISION_SIMD_WIDTH; ++i) {
+        f32 dx = circle.center.x - bx[i];
+        f32 dy = circle.center.y - by[i];
+        f32 ox = std::min(std::max(dx, -hx[i]), hx[i]) - dx;
+        f32 oy = std::min(std::max(dy, -hy[i]), hy[i]) - dy;
+        if (ox * ox + oy * oy <= radiusSq) {
+            mask |= 1u << i;
+        }
+    }
+
+    return mask;
+#endif
+}
+
+inline
+AABBBatchHit CircleVsAABBs(const AABBSoA &soa, u32 begin, Circle circle) {
+    AABBBatchHit result = {};
+    u32 groupsNum = soa.GetGroupsNum();
+    for (u32 group = begin / COLLISION_SIMD_WIDTH; group < groupsNum; ++group) {
+        u32 groupStart = group * COLLISION_SIMD_WIDTH;
+        u32 mask = CircleVsAABBGroup(soa, groupStart, circle);
+
+        // drop the boxes of the first group which are before begin, a call resuming after a hit counted them already
+        u32 firstLane = begin > groupStart ? begin - groupStart : 0;
+        mask &= ~((1u << firstLane) - 1);
+        result.testsNum += COLLISION_SIMD_WIDTH - firstLane;
+
+        if (mask) {
+            u32 lane = 0;
+            while (!(mask & (1u << lane))) {
+                lane++;
+            }
+
+            u32 index = groupStart + lane;
+            AABB aabb = { Vector2{ soa.centerX[index], soa.centerY[index] }, Vector2{ soa.halfX[index], soa.halfY[index] } };
+
+            result.first = (int)index;
+            result.mask = mask;
+            result.groupStart = groupStart;
+            result.manifold = AABBvsCircle(aabb, circle);
+            break;
+        }
+    }
+
+    return result;
+}
+
+}
@@ -9,6 +9,37 @@
 #include <type_traits>
 
 #define DEVELOPER 0
+// no window, no GPU resources. Set by the benchmark project
+#ifndef HEADLESS
+#define HEADLESS 0
+#endif
+// components are stored in per type pools instead of per object arenas
+#define COMPONENT_POOLS 1
+// simulation runs in TIME_STEP increments, rendering interpolates between the last two steps
+#define FIXED_TIMESTEP 1
+// simulation steps of the next frame run on their own thread while the current frame is rendered, needs FIXED_TIMESTEP
+#define PIPELINED_SIMULATION 1
+// static blocks are looked up through a uniform grid, otherwise every block is tested by the SIMD kernel
+#define BLOCK_GRID 1
+// component types marked with PARALLEL_TICK tick their pools on the job system, so does the block lookup of many balls
+#define JOB_SYSTEM 1
+// global operator new is replaced to count heap allocations
+#define TRACK_HEAP_ALLOCATIONS 1
+// swaps wait for the vertical blank
+#define VSYNC 0
+// PROFILE_SCOPE markers record into the frame profiler, F3 shows the overlay. 0 compiles them out
+#define PROFILER 1
+// the input of every session is recorded to session.brpl, BreakoutBench --replay re-simulates it. Needs FIXED_TIMESTEP
+#define REPLAY_RECORDING 1
+// developer builds: the gameplay is also built as BreakoutGameplay.dll, which the game reloads whenever it's rebuilt.
+// Set by the HotReload configuration, see hot_reload.h
+#ifndef HOT_RELOAD
+#define HOT_RELOAD 0
+#endif
+// set when compiling the gameplay module itself, it works on the game state and the singletons of the host
+#ifndef HOT_RELOAD_MODULE
+#define HOT_RELOAD_MODULE 0
+#endif
 
 using f64 = double;
 using f32 = float;
@@ -17,6 +48,7 @@ using i16 = int16_t;
 using i32 = int32_t;
 using i64 = int64_t;
 using u8 = uint8_t;
+using u16 = uint16_t;
 using u32 = uint32_t;
 using u64 = uint64_t;
 using b32 = int32_t;
@@ -40,6 +72,10 @@ struct AppSettings {
 
 static constexpr int TARGET_FPS = 90;
 static constexpr f32 TIME_STEP = 1.0f / static_cast<f32>(TARGET_FPS);
+// 0 means uncapped. The frame pacer goes up to the monitor's refresh rate when it's higher
+static constexpr int RENDER_TARGET_FPS = 120;
+// longer frames are clamped, so a hitch doesn't turn into a burst of simulation steps
+static constexpr f32 MAX_FRAME_TIME = 0.25f;
 
 template <typename T, int N>
 struct Buffer {
@@ -48,8 +84,9 @@ struct Buffer {
 
     static_assert(std::is_trivially_copyable<T>::value &&std::is_standard_layout<T>::value, "T must be a POD-like type");
 
+    // T is trivially copyable (see above), its bytes can be zeroed even when it has default member initializers
     Buffer() {
-        memset(data, 0, sizeof(data));
+        memset(static_cast<void *>(data), 0, sizeof(data));
     }
 
     T &operator[](int index) {
@@ -68,12 +105,23 @@ struct Buffer {
     }
 
     void Clear() {
-        memset(data, 0, sizeof(data));
+        memset(static_cast<void *>(data), 0, sizeof(data));
         len = 0;
     }
 };
 
 
+#if HOT_RELOAD_MODULE
+// handed over by the host before the module runs anything, singletons return these instead of their own
+template <typename T>
+struct HostInstance {
+    static T *instance;
+};
+
+template <typename T>
+T *HostInstance<T>::instance = nullptr;
+#endif
+
 namespace globals {
 	AppSettings appSettings;
 }
\ No newline at end of file
@@ -0,0 +1,129 @@
+#pragma once
+
+#include <raylib.h>
+#include "common.h"
+#include <math.h>
+
+//NOTE: picks the resolution the frame is rendered at. The logical screen (screenWidth x screenHeight) is fitted into
+// the window and rendered at the window's pixel density, times a quality factor driven by the measured draw time.
+// At full quality the frame is drawn straight into the back buffer, letterboxed with a scissor, so there is no
+// offscreen pass at all. Below it the frame goes through a smaller render target which is stretched to the window.
+//
+// There are no gpu timer queries without touching gl directly, the draw time is measured on the cpu side: from the
+// first draw call to the end of the swap. A gpu bound frame blocks in the swap once the driver's queue is full,
+// so it shows up there. With VSYNC the swap waits for the vertical blank instead, then the swap isn't measured.
+
+class DynamicResolution {
+public:
+    static constexpr f32 MIN_QUALITY = 0.5f;
+    // quality changes by steps, so the render target isn't recreated for every small change in the draw time
+    static constexpr f32 QUALITY_STEP = 0.125f;
+    // draws are budgeted this fraction of the frame, the rest is left to the cpu side and the os
+    static constexpr f64 BUDGET_FRACTION = 0.75;
+    // frames between two quality changes, the draw time needs a few frames to settle
+    static constexpr int COOLDOWN_FRAMES = 30;
+
+    void Init();
+    void Shutdown();
+
+    // once per frame before drawing: follows the window size and adapts the quality to the last draw times
+    void Update(f64 drawSeconds, f64 frameSeconds);
+
+    // true when the frame is drawn straight into the back buffer
+    bool IsDirect() const { return m_target.id == 0; }
+    RenderTexture2D GetTarget() const { return m_target; }
+    // the logical screen in the window, in window pixels
+    Rectangle GetDestination() const { return m_destination; }
+    // pixels per logical unit in what the frame is drawn into
+    f32 GetRenderScale() const { return m_windowScale * m_quality; }
+
+    // below the profiler overlay, returns the y under the text
+    f32 DrawStats(f32 x, f32 y) const;
+
+private:
+    void ResizeTarget(int width, int height);
+
+    f32                 m_windowScale = 1.0f;
+    f32                 m_quality = 1.0f;
+    Rectangle           m_destination = {};
+    RenderTexture2D     m_target = {};
+    f64                 m_drawSeconds = 0.0;
+    f64                 m_budgetSeconds = 0.0;
+    int                 m_cooldown = 0;
+};
+
+void DynamicResolution::Init() {
+    m_quality = 1.0f;
+    m_cooldown = COOLDOWN_FRAMES;
+    Update(0.0, 0.0);
+}
+
+void DynamicResolution::Shutdown() {
+    ResizeTarget(0, 0);
+}
+
+void DynamicResolution::Update(f64 drawSeconds, f64 frameSeconds) {
+    m_drawSeconds += (drawSeconds - m_drawSeconds) * 0.1;
+    m_budgetSeconds = frameSeconds * BUDGET_FRACTION;
+
+    if (m_cooldown > 0) {
+        m_cooldown--;
+    }
+    else if (m_budgetSeconds > 0.0) {
+        // fill cost goes with the pixel count, a step up is taken only if the predicted time still fits
+        f64 upQuality = std::min(1.0f, m_quality + QUALITY_STEP);
+        f64 upRatio = (upQuality * upQuality) / (m_quality * m_quality);
+        if (m_drawSeconds > m_budgetSeconds && m_quality > MIN_QUALITY) {
+            m_quality = std::max(MIN_QUALITY, m_quality - QUALITY_STEP);
+            m_cooldown = COOLDOWN_FRAMES;
+        }
+        else if (m_quality < 1.0f && m_drawSeconds * upRatio < m_budgetSeconds * 0.85) {
+            m_quality = static_cast<f32>(upQuality);
+            m_cooldown = COOLDOWN_FRAMES * 2;
+        }
+    }
+
+    m_windowScale = globals::appSettings.GetResolutionScale();
+
+    f32 width = globals::appSettings.screenWidth * m_windowScale;
+    f32 height = globals::appSettings.screenHeight * m_windowScale;
+    m_destination = Rectangle{ floorf((GetScreenWidth() - width) * 0.5f), floorf((GetScreenHeight() - height) * 0.5f), width, height };
+
+    if (m_quality >= 1.0f) {
+        ResizeTarget(0, 0);
+    }
+    else {
+        ResizeTarget(std::max(1, (int)(width * m_quality + 0.5f)), std::max(1, (int)(height * m_quality + 0.5f)));
+    }
+}
+
+void DynamicResolution::ResizeTarget(int width, int height) {
+    if (m_target.id != 0 && m_target.texture.width == width && m_target.texture.height == height) {
+        return;
+    }
+
+    if (m_target.id != 0) {
+        UnloadRenderTexture(m_target);
+        m_target = {};
+    }
+
+    if (width > 0 && height > 0) {
+        m_target = LoadRenderTexture(width, height);
+        // stretched by a fractional factor, point sampling would make the pixels uneven
+        SetTextureFilter(m_target.texture, TEXTURE_FILTER_BILINEAR);
+    }
+}
+
+f32 DynamicResolution::DrawStats(f32 x, f32 y) const {
+    const int fontSize = 20;
+    const int lineHeight = fontSize + 4;
+
+    int width = IsDirect() ? (int)m_destination.width : m_target.texture.width;
+    int height = IsDirect() ? (int)m_destination.height : m_target.texture.height;
+
+    DrawRectangle((int)x, (int)y, 560, lineHeight + 8, Fade(BLACK, 0.75f));
+    DrawText(TextFormat("render %dx%d %s, draw %.2f / %.2f ms", width, height, IsDirect() ? "direct" : "scaled",
+        m_drawSeconds * 1e3, m_budgetSeconds * 1e3), (int)x + 8, (int)y + 4, fontSize, WHITE);
+
+    return y + lineHeight + 8;
+}
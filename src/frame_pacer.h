@@ -0,0 +1,171 @@
+#pragma once
+
+#include <raylib.h>
+#include "common.h"
+#include "profiler.h"
+#include <chrono>
+#include <thread>
+
+//NOTE: frame pacing and late input sampling. SetTargetFPS sleeps at the end of EndDrawing, so the input polled after
+// it is up to a frame old by the time the next frame is simulated and the sleep itself is only as precise as the os
+// timer. The pacer does the waiting at the start of the frame instead: it waits for the frame's deadline, polls the
+// input events right after and only then hands the frame time to the simulation. Hybrid sleeps most of the wait and
+// spins the rest, BusyWait spins all of it for the lowest jitter at the cost of a core.
+
+enum class FramePacing : u8 {
+    // SetTargetFPS, raylib sleeps in EndDrawing
+    RaylibTimer,
+    // no waiting, only vsync (VSYNC in common.h) limits the rate
+    Uncapped,
+    Hybrid,
+    BusyWait,
+    Count
+};
+
+static constexpr FramePacing DEFAULT_FRAME_PACING = FramePacing::Hybrid;
+
+class FramePacer {
+public:
+    // the os sleep overshoots by up to a scheduler tick, the last part of the wait is spun
+    static constexpr f64 SPIN_THRESHOLD = 0.002;
+
+    void Init(FramePacing pacing, int targetFps, int refreshRate);
+    void SetPacing(FramePacing pacing);
+    FramePacing GetPacing() const { return m_pacing; }
+    // raylib sleeps in EndDrawing until the frame period is over
+    bool WaitsInSwap() const { return m_pacing == FramePacing::RaylibTimer; }
+    void CyclePacing() { SetPacing(static_cast<FramePacing>((static_cast<int>(m_pacing) + 1) % static_cast<int>(FramePacing::Count))); }
+
+    // waits for the next frame and polls the input events, returns the time since the previous frame.
+    // Input sampled by the caller right after it is as fresh as the pacing allows
+    f32 BeginFrame();
+    // time BeginFrame sampled the input at, seconds on the pacer clock
+    f64 GetInputSampleTime() const { return m_inputSampleTime; }
+    // call once the frame showing the input sampled at sampleTime was swapped
+    void OnPresent(f64 sampleTime);
+
+    // seconds on the pacer clock
+    f64 Now() const { return std::chrono::duration<f64>(std::chrono::steady_clock::now() - m_epoch).count(); }
+    // time of one frame at the target rate, a refresh when uncapped
+    f64 GetFramePeriod() const { return m_period > 0.0 ? m_period : 1.0 / m_refreshRate; }
+
+    // below the profiler overlay, returns the y under the text
+    f32 DrawStats(f32 x, f32 y) const;
+
+    static const char *GetPacingName(FramePacing pacing);
+
+private:
+    void WaitUntil(f64 deadline) const;
+
+    std::chrono::steady_clock::time_point   m_epoch = std::chrono::steady_clock::now();
+    FramePacing                             m_pacing = FramePacing::RaylibTimer;
+    int                                     m_targetFps = 0;
+    int                                     m_refreshRate = 60;
+    f64                                     m_period = 0.0;
+    f64                                     m_frameStart = 0.0;
+    f64                                     m_nextDeadline = 0.0;
+    f64                                     m_inputSampleTime = 0.0;
+    // smoothed, sample to the end of the swap
+    f64                                     m_inputToSwap = 0.0;
+    f64                                     m_frameTime = 0.0;
+};
+
+void FramePacer::Init(FramePacing pacing, int targetFps, int refreshRate) {
+    m_targetFps = targetFps;
+    m_refreshRate = refreshRate > 0 ? refreshRate : 60;
+    m_period = targetFps > 0 ? 1.0 / targetFps : 0.0;
+    m_frameStart = Now();
+    m_nextDeadline = m_frameStart + m_period;
+    m_inputSampleTime = m_frameStart;
+    SetPacing(pacing);
+}
+
+void FramePacer::SetPacing(FramePacing pacing) {
+    m_pacing = pacing;
+    // the other modes wait themselves, EndDrawing must not sleep on top of it
+    SetTargetFPS(m_pacing == FramePacing::RaylibTimer ? m_targetFps : 0);
+    m_nextDeadline = Now() + m_period;
+    m_inputToSwap = 0.0;
+}
+
+void FramePacer::WaitUntil(f64 deadline) const {
+    if (m_pacing == FramePacing::Hybrid) {
+        f64 remaining = deadline - Now();
+        while (remaining > SPIN_THRESHOLD) {
+            std::this_thread::sleep_for(std::chrono::duration<f64>(remaining - SPIN_THRESHOLD));
+            remaining = deadline - Now();
+        }
+    }
+
+    while (Now() < deadline) {
+        std::this_thread::yield();
+    }
+}
+
+f32 FramePacer::BeginFrame() {
+    PROFILE_SCOPE("Pacing");
+
+    if ((m_pacing == FramePacing::Hybrid || m_pacing == FramePacing::BusyWait) && m_period > 0.0) {
+        WaitUntil(m_nextDeadline);
+
+        // a frame which ran over starts a new schedule, catching up would only burst frames
+        f64 now = Now();
+        m_nextDeadline += m_period;
+        if (m_nextDeadline < now) {
+            m_nextDeadline = now + m_period;
+        }
+
+        // EndDrawing polled before the wait, the events of the wait are picked up now
+        PollInputEvents();
+    }
+
+    f64 now = Now();
+    m_frameTime = now - m_frameStart;
+    m_frameStart = now;
+    m_inputSampleTime = now;
+
+    // raylib's frame time includes its own sleep, it's what the old loop used
+    if (m_pacing == FramePacing::RaylibTimer) {
+        return GetFrameTime();
+    }
+
+    return static_cast<f32>(m_frameTime);
+}
+
+void FramePacer::OnPresent(f64 sampleTime) {
+    f64 now = Now();
+    f64 latency = now - sampleTime;
+    m_inputToSwap = m_inputToSwap == 0.0 ? latency : m_inputToSwap + (latency - m_inputToSwap) * 0.05;
+
+#if PROFILER
+    u64 end = Profiler::Instance().Now();
+    Profiler::Instance().Record("InputToSwap", end - static_cast<u64>(latency * 1e9), end);
+#endif
+}
+
+f32 FramePacer::DrawStats(f32 x, f32 y) const {
+    const int fontSize = 20;
+    const int lineHeight = fontSize + 4;
+
+    // after the swap the panel still has to scan the frame out, on average half a refresh to the middle of the screen
+    f64 scanout = 0.5 / m_refreshRate;
+    f64 inputToPhoton = m_inputToSwap + scanout;
+
+    DrawRectangle((int)x, (int)y, 560, lineHeight * 2 + 8, Fade(BLACK, 0.75f));
+    DrawText(TextFormat("pacing %s, %d fps target, %d Hz panel, F5 cycles", GetPacingName(m_pacing), m_targetFps, m_refreshRate),
+        (int)x + 8, (int)y + 4, fontSize, WHITE);
+    DrawText(TextFormat("input to photon ~%.1f ms (swap %.1f + scanout %.1f)", inputToPhoton * 1e3, m_inputToSwap * 1e3, scanout * 1e3),
+        (int)x + 8, (int)y + 4 + lineHeight, fontSize, WHITE);
+
+    return y + lineHeight * 2 + 8;
+}
+
+const char *FramePacer::GetPacingName(FramePacing pacing) {
+    switch (pacing) {
+    case FramePacing::RaylibTimer: return "raylib timer";
+    case FramePacing::Uncapped: return VSYNC ? "vsync" : "uncapped";
+    case FramePacing::Hybrid: return "hybrid";
+    case FramePacing::BusyWait: return "busy wait";
+    default: return "?";
+    }
+}
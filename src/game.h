@@ -1,13 +1,17 @@
 #pragma once
 
 #include <raymath.h>
-#include <time.h>
-#include <unordered_set>
 #include "gamelib.h"
+#include "collision_simd.h"
+#include "sprite_atlas.h"
+#include "level_file.h"
+#include "replay.h"
 
 namespace breakout {
 
 class Map;
+class BallComponent;
+class AlienComponent;
 
 enum class Collision {
     None,
@@ -17,6 +21,19 @@ enum class Collision {
     Right,
 };
 
+// pools tick in this order. It's the order InitScene creates the objects in, which is the order they ticked and
+// submitted their draws in before the pools (the ball is drawn below the portal)
+enum class ComponentType : ComponentTypeId {
+    PlayerComponent = 0,
+    BallComponent,
+    PortalComponent,
+    AlienComponent,
+    BlockComponent,
+    Count
+};
+
+static_assert(static_cast<int>(ComponentType::Count) <= MAX_COMPONENT_TYPES, "Increase MAX_COMPONENT_TYPES");
+
 enum class CollidableType {
     Alien,
     Block,
@@ -24,27 +41,106 @@ enum class CollidableType {
 };
 
 class CollisionManager {
+    // the object is referenced by handle, a collidable outliving its object stops resolving instead of
+    // pointing at whatever took the slot over
     struct Collidable {
-        GameObject *    go;
-        Rectangle       bounds;
+        GameObjectHandle    handle;
+        Rectangle           bounds;
+    };
+
+    //NOTE: collidables with a back-map from the object's handle index, removal is a swap with the last one
+    struct CollidableList {
+        static constexpr u32 NONE = std::numeric_limits<u32>::max();
+
+        std::vector<Collidable>     items;
+        std::vector<u32>            indices;
+        // bounds of the items in the same order, only for lists of static collidables
+        AABBSoA                     soa;
+        bool                        keepSoA = false;
+
+        void Add(const Collidable &collidable);
+        // nullptr when the object isn't in the list
+        Collidable *Find(GameObjectHandle handle);
+        bool Remove(GameObjectHandle handle);
+        void Clear();
     };
 public:
+    // balls moving more than this fraction of their radius in one step are swept against the blocks
+    static constexpr f32 SWEEP_THRESHOLD = 0.5f;
+
+    // the SoA bounds only feed the SIMD path, which runs without the block grid
+    CollisionManager() { m_blocks.keepSoA = !BLOCK_GRID; }
+
     void Add(CollidableType type, GameObject *go, Rectangle bounds);
     void Remove(CollidableType type, GameObject *go);
+    // removals requested while ticking are applied by ApplyRemovals, after the simulation step
+    void QueueRemove(CollidableType type, GameObject *go);
+    void ApplyRemovals();
+    // area (top-left + size) is covered even where there are no blocks yet, streamed blocks land in it without a rebuild
+    void BuildBlockGrid(Vector2 cellSize, Rectangle area);
+    // room for count more blocks, for bulk spawns
+    void ReserveBlocks(u32 count);
     void Tick();
+    // narrowphase tests run by the last Tick
+    u32 GetTestsNum() const { return m_testsNum; }
     void DebugDraw();
     void Clear();
 private:
-    void RemoveCollidable(std::vector<Collidable> &collidable, GameObject *testGo);
-    std::vector<Collidable> m_aliens;
-    std::vector<Collidable> m_balls;
-    std::vector<Collidable> m_blocks;
+    static constexpr int MAX_BLOCKS_PER_CELL = 4;
+
+    struct PendingRemoval {
+        CollidableType      type;
+        GameObjectHandle    handle;
+    };
+
+    // nullptr once the object is destroyed
+    static GameObject *Resolve(const Collidable &collidable);
+    void Remove(CollidableType type, GameObjectHandle handle);
+
+    static constexpr int MAX_SWEPT_BOUNCES = 4;
+    // balls per job when the blocks around the balls are looked up on the job system, one job's worth runs inline
+    static constexpr u32 BALLS_PER_JOB = 16;
+    static constexpr int MAX_BALL_CONTACTS = 16;
+
+    //NOTE: blocks a ball touches at the start of the block pass, in lookup order, found by FindBallContacts. The hits
+    // are applied in ball order on the calling thread, a block hit by an earlier ball is skipped like without contacts
+    struct BallContacts {
+        Collidable  blocks[MAX_BALL_CONTACTS];
+        u32         count;
+        u32         testsNum;
+        // touches more blocks than fit, the ball is looked up again when the hits are applied
+        bool        overflow;
+    };
+
+    // doesn't count the test, the callers do: the SIMD prefilter already counted its candidates
+    bool CollideBallWithBlock(GameObject *ballGo, BallComponent *ballComp, Circle circle, Collidable block);
+    // moves the ball along start to end, bouncing off every block hit on the way
+    void SweepBall(Collidable &ball, GameObject *ballGo, BallComponent *ballComp, Vector2 start, Vector2 end);
+    // fn(block) for the blocks around circle in lookup order until fn returns true, candidates are counted into testsNum.
+    // Only reads the lists, jobs call it
+    template <typename Fn>
+    void QueryBlocks(Circle circle, u32 &testsNum, Fn &&fn);
+    // m_ballContacts of every ball on the job system
+    void FindBallContacts();
+    CollidableList          m_aliens;
+    CollidableList          m_balls;
+    CollidableList          m_blocks;
+    // static blocks only, built by Map::Load
+    UniformGrid<Collidable, MAX_BLOCKS_PER_CELL> m_blockGrid;
+    Rectangle               m_blockGridArea = {};
+    std::vector<PendingRemoval> m_pendingRemovals;
+    // per ball of m_balls, valid during Tick when there were more balls than BALLS_PER_JOB
+    std::vector<BallContacts> m_ballContacts;
+    u32                     m_testsNum = 0;
 };
 
 struct HUD {
     View        container;
     View        text;
     int         fontId;
+    // formatted only when the score changes, the text cache keeps its layout
+    int         shownScore = -1;
+    char        scoreText[32] = {};
 
     void Init(View root, ResHandle fontHandle);
     void Draw();
@@ -151,6 +247,32 @@ struct Menu {
 };
 
 static constexpr f32 GAME_RESET_DIFF = 2.0f;
+static constexpr const char *FIRST_LEVEL_FILE = "assets/levels/level01.blvl";
+
+// simulation state read by Draw, copied by PrepareDraw so rendering never looks at the live state
+struct DrawSnapshot {
+    GameplayState       gameplayState;
+    Menu                menu;
+    int                 hitScore = 0;
+    u64                 stepHeapAllocations = 0;
+    Camera2D            camera = {};
+    Vector2             prevCameraTarget = {};
+};
+
+// where Draw puts the logical screen (screenWidth x screenHeight) in the current render target, in target pixels
+struct DrawView {
+    Vector2             origin = {};
+    f32                 scale = 1.0f;
+};
+
+// resource slots resolved once by Initialize, draws index them instead of looking names up.
+// Headless runs load nothing and keep the placeholder slot 0
+struct ResourceIds {
+    int                 atlas = 0;
+    int                 background = 0;
+    int                 menuBackground = 0;
+    int                 font = 0;
+};
 
 struct GameState {
     GameplayState       gameplayState;
@@ -161,20 +283,63 @@ struct GameState {
     GameObjectManager   goMgr;
     CollisionManager    collisionMgr;
     Camera2D            camera;
+    // camera target before the last step, the view scrolls smoothly between steps
+    Vector2             prevCameraTarget;
     Map *               map;
     GameObject *        player;
     GameObject *        ball;
+    // prewarmed by InitScene, portals take their aliens from here
+    ObjectPool<AlienComponent> alienPool;
     int                 hitScore;
     Resources           res;
-    RecordedDrawItems   recordedDrawings;
+    ResourceIds         resIds;
+    InputState          input;
+    DrawSnapshot        drawSnapshot;
+    // view of the current step, draws outside of it are skipped
+    Visibility          visibility;
+    // transient per step memory, draw lists and their text
+    FrameArena          frameArena;
+    // gpu resources released by the simulation, unloaded by PrepareDraw on the main thread
+    Buffer<RenderTexture2D, 4> pendingUnloads;
+    // heap allocations made by the last Update, expected to be 0 while playing
+    u64                 stepHeapAllocations;
     f32                 resetTimer;
+    // simulation clock, advanced by Update. Gameplay timers must use it instead of GetTime()
+    f64                 time;
+    // set by PollInput, replays record it with the input
+    bool                assetsReady;
+    // state after every step folded together, replays compare it
+    u64                 checksum;
+#if REPLAY_RECORDING
+    ReplayRecorder      recorder;
+#endif
 };
 
+#if HOT_RELOAD_MODULE
+// the gameplay module never has a state of its own, it runs on the host's
+#define g_gameState (*HostInstance<GameState>::instance)
+#else
 static GameState g_gameState;
+#endif
 
+//NOTE: the tiles of the whole level are kept as one byte each, block objects only exist around the view. The rows
+// are split into chunks of CHUNK_ROWS, StreamChunks activates the chunks near the view (blocks and collidables for
+// the tiles left in them) and evicts the far ones back to the tiles. Objects and collidables follow the size of the
+// view, not the size of the level.
 class Map {
 public:
+    static constexpr f32 PADDING = 5.0f;
+    // bigger block fields are not cached, blocks are drawn one by one
+    static constexpr int MAX_BLOCK_LAYER_SIZE = 4096;
+    static constexpr int CHUNK_ROWS = 8;
+    // chunks activated ahead of the view on each side, they are evicted once they're twice as far
+    static constexpr int STREAM_MARGIN_CHUNKS = 1;
+
     Map(Vector2 origin, Vector2 tileSize, int width, int height);
+    ~Map();
+
+    Map(const Map &other) = delete;
+    Map &operator=(const Map &other) = delete;
 
     inline int GetWidth() const { return m_width; }
     inline int GetHeight() const { return m_height; }
@@ -182,13 +347,79 @@ public:
     Rectangle GetBounds() const;
     Vector2 GetOrigin() const;
     Vector2 GetTileSize() const { return m_tileSize; }
-    void Load(u8 *data);
+    Vector2 GetTilePosition(int x, int y) const;
+    // level dimensions must match the map, the tiles are only read during the call. Activates the chunks
+    // around the current view
+    void Load(const LevelData &level);
+    void RemoveTile(int index);
+    // view is in worldDim form (min x, min y, max x, max y). Runs at the start of a step, before anything ticks
+    void StreamChunks(Rectangle view);
+    // lowest row with tiles left, the height once every tile is gone
+    int GetLowestRow() const { return m_lowestRow; }
+    int GetResidentChunksNum() const { return static_cast<int>(m_residentChunks.size()); }
+
+    // static block layer, the whole field is rendered once into a render texture and only dirty tiles are redrawn
+    bool IsBlockLayerCached() const { return m_blockLayerState == BlockLayerState::Ready; }
+    // needs the GL context, must run outside of any texture mode. The layer is rendered at renderScale pixels
+    // per unit, a different scale than last time renders it again
+    void RefreshBlockLayer(f32 renderScale);
+    // the cached layer as one item, without it the tiles in the visibility view one by one
+    void SubmitBlocks();
 private:
+    enum class BlockLayerState {
+        Disabled,
+        NeedsFullRender,
+        Ready
+    };
+
+    struct Chunk {
+        // tiles left, chunks without any aren't activated
+        u32                 tilesNum = 0;
+        // index in m_residentChunks, -1 while the chunk only exists as tiles
+        int                 resident = -1;
+    };
+
+    struct ResidentChunk {
+        int                             chunk;
+        // blocks the activation created, the ones destroyed since don't resolve anymore
+        std::vector<GameObjectHandle>   blocks;
+    };
+
+    Rectangle GetFieldBounds() const;
+    void DrawTiles(int x0, int y0, int x1, int y1);
+    // tiles overlapping the world space range, false if there are none
+    bool GetRowRange(f32 minY, f32 maxY, int &first, int &last) const;
+    bool GetColumnRange(f32 minX, f32 maxX, int &first, int &last) const;
+    // chunks with rows between minY and maxY in world space, false if there are none
+    bool GetChunkRange(f32 minY, f32 maxY, int &first, int &last) const;
+    void ActivateChunk(int chunk);
+    void EvictChunk(int resident);
+
     int                     m_width = 0;
     int                     m_height = 0;
     int                     m_blocksNum = 0;
+    int                     m_tilesLeft = 0;
     Vector2                 m_tileSize;
     Vector2                 m_origin;
+    std::vector<u8>         m_tiles;
+    // tiles left per row
+    std::vector<u16>        m_rowTiles;
+    int                     m_lowestRow = 0;
+    std::vector<Chunk>      m_chunks;
+    std::vector<ResidentChunk> m_residentChunks;
+    // block lists of evicted chunks, the next activations reuse them
+    std::vector<std::vector<GameObjectHandle>> m_spareBlockLists;
+
+    BlockLayerState         m_blockLayerState = BlockLayerState::Disabled;
+    RenderTexture2D         m_blockLayer = {};
+    f32                     m_blockLayerScale = 1.0f;
+    // replaced by a rescale, the presented draw lists may still use it. The next SubmitBlocks queues the unload
+    RenderTexture2D         m_retiredBlockLayer = {};
+    // dirty tile range, empty when min > max
+    int                     m_dirtyMinX = 0;
+    int                     m_dirtyMinY = 0;
+    int                     m_dirtyMaxX = -1;
+    int                     m_dirtyMaxY = -1;
 };
 
 
@@ -199,6 +430,8 @@ public:
     static constexpr f32 SPEED = 800.0f;
     static constexpr f32 WIDTH = 128.0f;
     static constexpr f32 HEIGHT = 32.0f;
+    // from the bottom of the view, the paddle follows it when the level scrolls
+    static constexpr f32 BOTTOM_OFFSET = 40.0f;
 
     PlayerComponent(f32 x, f32 y, f32 w, f32 h);
 
@@ -224,11 +457,12 @@ class PortalComponent : public Component {
     static constexpr f32 SPAWN_TIME_DIFF = 10.0f;
     static constexpr f32 INVADE_TIME_DIFF = 2.0f;
     static constexpr int MAX_SPAWNING_POINTS = 4;
-    static constexpr int MAX_ALIENS = 4;
-    static constexpr f32 ALIEN_SIZE = 128.0f;
-    static constexpr f32 ALIEN_RADIUS = 64.0f;
 
 public:
+    // per wave, the alien pool is prewarmed with this many
+    static constexpr int MAX_ALIENS = 4;
+    static_assert(MAX_ALIENS <= 32, "Fallen aliens are tracked in a u32 mask");
+
     COMPONENT_NAME(PortalComponent)
     
     void OnInit() override;
@@ -239,13 +473,15 @@ private:
     void SpawnAlien();
 
     Buffer<Vector2, MAX_SPAWNING_POINTS>            m_spawningPoints;
-    Buffer<GameObject *, MAX_SPAWNING_POINTS>       m_aliens;
-    std::unordered_set<int>                         m_fallenAliens;
+    Buffer<AlienComponent *, MAX_ALIENS>            m_aliens;
+    // bit i is set once m_aliens[i] fell
+    u32                                             m_fallenAliens = 0;
     f32                                             m_lastInvadeTime;
     f32                                             m_lastSpawnTime;
     State                                           m_state;
     f32                                             m_radius;
     int                                             m_textureId;
+    Rectangle                                       m_textureSrc;
 };
 
 class BallComponent : public Component {
@@ -254,11 +490,13 @@ class BallComponent : public Component {
         Launched
     };
 
-    static constexpr Vector2 INIT_VELOCITY = { 100.0f, -660.0f };
 public:
+    static constexpr Vector2 INIT_VELOCITY = { 100.0f, -660.0f };
     static constexpr f32 WIDTH = 64.0f;
     static constexpr f32 HEIGHT = 64.0f;
     static constexpr f32 RADIUS = 32.0f;
+    // an attached ball waits this far above the paddle
+    static constexpr f32 SERVE_OFFSET = 70.0f;
 
     COMPONENT_NAME(BallComponent)
 
@@ -268,28 +506,40 @@ public:
     void Launch();
     void Tick(f32 dt) override;
     void OnCollision(const CollisionManifold &manifold, GameObject *collidedObject) override;
+    // the swept test moves the ball to the contact point and reflects the velocity about the normal
+    void OnSweptCollision(Vector2 center, Vector2 normal);
     f32 GetRadius() const { return m_radius; }
     Vector2 GetCenter() const { return { m_position.x + m_radius, m_position.y + m_radius }; }
+    Vector2 GetPrevCenter() const { return { m_prevPosition.x + m_radius, m_prevPosition.y + m_radius }; }
+    void SetCenter(Vector2 center) { m_position = { center.x - m_radius, center.y - m_radius }; }
+    Vector2 GetVelocity() const { return m_velocity; }
+    void SetVelocity(Vector2 velocity) { m_velocity = velocity; }
     bool IsLaunched() const { return m_state == State::Launched; }
 private:
     void ResolvePlayerCollision(PlayerComponent *playerComp);
     void ResolveBlockCollision(const CollisionManifold &manifold);
 
-    State   m_state;
-    Vector2 m_velocity;
-    f32     m_radius;
-    int     m_textureId = 0;
+    State       m_state;
+    Vector2     m_velocity;
+    f32         m_radius;
+    int         m_textureId = 0;
+    Rectangle   m_textureSrc = {};
 };
 
 class AlienComponent : public Component {
     static constexpr f32 SPEED = 700.0f;
 public:
+    static constexpr f32 SIZE = 128.0f;
+    static constexpr f32 RADIUS = 64.0f;
 
     COMPONENT_NAME(AlienComponent)
+    static constexpr bool PARALLEL_TICK = true;
 
     AlienComponent(f32 x, f32 y, f32 w, f32 h, f32 r);
 
     void OnInit() override;
+    // restarts a pooled alien at position, heading for the player
+    void Spawn(Vector2 position);
     void Tick(f32 dt) override;
     bool Fell() const { return m_fellDown; }
     Vector2 GetCenter() const { return { m_position.x + m_radius, m_position.y + m_radius }; }
@@ -303,49 +553,55 @@ private:
     bool        m_fellDown = false;
 };
 
+// drawn by the map from the tiles, the objects only collide
 class BlockComponent : public Component {
 public:
     COMPONENT_NAME(BlockComponent)
+    static constexpr bool TICKS = false;
 
-    BlockComponent(f32 x, f32 y, f32 width, f32 height);
+    static constexpr Rectangle TEXTURE_SRC = GetSpriteRect(SpriteId::Block);
+
+    BlockComponent(f32 x, f32 y, f32 width, f32 height, int tileIndex);
     void OnInit() override;
-    void Tick(f32) override;
+    void Tick(f32) override {}
     Vector2 GetCenter() const { return { m_position.x + (m_size.x * 0.5f), m_position.y + (m_size.y * 0.5f) }; }
     void OnCollision(const CollisionManifold &manifold, GameObject *go);
 private:
-    int         m_textureId = 0;
-    Rectangle   m_textureSrc = {};
+    int         m_tileIndex = 0;
 };
 
 
 PlayerComponent::PlayerComponent(f32 x, f32 y, f32 w, f32 h) {
     m_position = { x, y };
+    m_prevPosition = m_position;
     m_size = { w, h };
 }
 
 
 void PlayerComponent::OnInit() {
-    m_textureId = g_gameState.res.Acquire("assets/tiles.png");
-    m_textureSrc = Rectangle{ 96, 64, 16, 16 };
+    m_textureId = g_gameState.resIds.atlas;
+    m_textureSrc = GetSpriteRect(SpriteId::Player);
 }
 
 void PlayerComponent::Tick(f32 dt) {
+    m_prevPosition = m_position;
 
+    m_position.y = g_gameState.worldDim.height - BOTTOM_OFFSET;
     Vector2 newPosition = m_position;
     f32 velocity = m_velocity;
 
     f32 baseSpeed = SPEED;
 
-    if (IsKeyDown(KEY_LEFT_SHIFT)) {
+    if (g_gameState.input.IsKeyDown(KEY_LEFT_SHIFT)) {
         baseSpeed *= 2.0f;
     }
 
-    if (IsKeyDown(KEY_LEFT)) {
+    if (g_gameState.input.IsKeyDown(KEY_LEFT)) {
         velocity = baseSpeed * dt;
         newPosition.x -= velocity;
     }
 
-    if (IsKeyDown(KEY_RIGHT)) {
+    if (g_gameState.input.IsKeyDown(KEY_RIGHT)) {
         velocity = baseSpeed * dt;
         newPosition.x += velocity;
     }
@@ -355,22 +611,24 @@ void PlayerComponent::Tick(f32 dt) {
         m_position = newPosition;
     }
     
-    if (IsKeyPressed(KEY_SPACE)) {
+    if (g_gameState.input.IsKeyPressed(KEY_SPACE)) {
         BallComponent *ballComp = g_gameState.ball->GetComponent<BallComponent>();
         ballComp->Launch();
     }
 
-    DrawItem drawItem = {};
-    drawItem.position = m_position;
-    drawItem.texture = g_gameState.res.textures[m_textureId];
-    drawItem.src = m_textureSrc;
-    drawItem.size = m_size;
-    drawItem.z_index = 0;
-    DrawManager::Instance().Add(drawItem);
+    if (!g_gameState.visibility.IsVisible(m_position, m_prevPosition, m_size)) {
+        return;
+    }
+
+    TextureDrawCmd cmd = CreateTextureDrawCmd(g_gameState.res.textures[m_textureId], m_textureSrc, m_position, m_size, DrawLayer::Default);
+    cmd.prevPosition = m_prevPosition;
+    cmd.interpolate = true;
+    DrawManager::Instance().Add(cmd);
 }
 
 void PortalComponent::OnInit() {
-    m_textureId = g_gameState.res.Acquire("assets/Portal.png");
+    m_textureId = g_gameState.resIds.atlas;
+    m_textureSrc = GetSpriteRect(SpriteId::Portal);
 
     m_state = State::Idle;
 
@@ -379,21 +637,24 @@ void PortalComponent::OnInit() {
     m_spawningPoints.Add(Vector2{ g_gameState.worldDim.x + 600.0f,  g_gameState.worldDim.y + 400.0f });
     m_spawningPoints.Add(Vector2{ g_gameState.worldDim.width - 400.0f,  g_gameState.worldDim.y + 400.0f });
 
-    m_lastSpawnTime = GetTime();
-    m_lastInvadeTime = GetTime();
+    m_lastSpawnTime = (f32)g_gameState.time;
+    m_lastInvadeTime = (f32)g_gameState.time;
 }
 
 void PortalComponent::OnDestroy() {
     m_state = State::Idle;
     m_aliens.Clear();
+    m_fallenAliens = 0;
     m_spawningPoints.Clear();
 }
 
 void PortalComponent::Tick(f32 dt) {
-    f32 currTime = GetTime();
+    f32 currTime = (f32)g_gameState.time;
     if (m_state == State::Idle && currTime - m_lastSpawnTime >= SPAWN_TIME_DIFF) {
         int idx = GetRandomValue(0, m_spawningPoints.len - 1);
+        // the points are relative to the view the level started with
         m_position = m_spawningPoints[idx];
+        m_position.y += g_gameState.camera.target.y;
         m_state = State::Spawned;
 
         return;
@@ -403,14 +664,10 @@ void PortalComponent::Tick(f32 dt) {
     if (m_state == State::Spawned) {
         SpawnAlien();
 
-        Texture2D texture = g_gameState.res.textures[m_textureId];
-        DrawItem drawItem = {};
-        drawItem.position = m_position;
-        drawItem.texture = texture;
-        drawItem.src = Rectangle{ 0, 0, (f32)texture.width, (f32)texture.height };
-        drawItem.size = Vector2{ 256, 256 };
-        drawItem.z_index = 0;
-        DrawManager::Instance().Add(drawItem);
+        if (g_gameState.visibility.IsVisible(Rectangle{ m_position.x, m_position.y, 256.0f, 256.0f })) {
+            Texture2D texture = g_gameState.res.textures[m_textureId];
+            DrawManager::Instance().Add(CreateTextureDrawCmd(texture, m_textureSrc, m_position, Vector2{ 256, 256 }, DrawLayer::Default));
+        }
     }
 
     if (m_state == State::Finalization) {
@@ -421,13 +678,17 @@ void PortalComponent::Tick(f32 dt) {
 void PortalComponent::SpawnAlien() {
     bool shouldSpawnAliens = m_aliens.len != MAX_ALIENS;
     if (shouldSpawnAliens) {
-        f32 currTime = GetTime();
+        f32 currTime = (f32)g_gameState.time;
         if (currTime - m_lastInvadeTime >= INVADE_TIME_DIFF) {
-            GameObject *alien = g_gameState.goMgr.Create();
-            alien->AddComponent<AlienComponent>(m_position.x, m_position.y, ALIEN_SIZE, ALIEN_SIZE, ALIEN_RADIUS);
-            m_aliens.Add(alien);
+            // the pool is sized for a full wave, an empty one means aliens leaked
+            AlienComponent *alien = g_gameState.alienPool.Acquire();
+            assert(alien && "Alien pool is exhausted");
+            if (alien) {
+                alien->Spawn(m_position);
+                m_aliens.Add(alien);
+            }
 
-            m_lastInvadeTime = GetTime();
+            m_lastInvadeTime = (f32)g_gameState.time;
         }
     }
     else {
@@ -438,23 +699,21 @@ void PortalComponent::SpawnAlien() {
 void PortalComponent::UpdateAliensLifetime() {
 
     for (int i = 0; i < m_aliens.len; ++i) {
-        auto *alien = m_aliens[i];
-        AlienComponent *alienComp = alien->GetComponent<AlienComponent>();
-        if (alienComp && alienComp->Fell()) {
-            m_fallenAliens.insert(alien->GetId());
+        if (m_aliens[i]->Fell()) {
+            m_fallenAliens |= 1u << i;
         }
     }
 
-    // every spawned alien has fallen into abyss
-    if (m_fallenAliens.size() == m_aliens.len) {
+    // every spawned alien has fallen into abyss, they go back to the pool
+    // shifted in 64 bits, a full 32 alien wave would shift a u32 by its width
+    u32 allFallen = static_cast<u32>((1ull << m_aliens.len) - 1);
+    if (m_fallenAliens == allFallen) {
         for (int i = 0; i < m_aliens.len; ++i) {
-            auto *alien = m_aliens[i];
-            g_gameState.collisionMgr.Remove(CollidableType::Alien, alien);
-            g_gameState.goMgr.Destroy(m_aliens[i]);
+            g_gameState.alienPool.Release(m_aliens[i]);
         }
 
-        m_fallenAliens.clear();
-        m_lastSpawnTime = GetTime();
+        m_fallenAliens = 0;
+        m_lastSpawnTime = (f32)g_gameState.time;
         m_aliens.Clear();
         m_state = State::Idle;
     }
@@ -462,6 +721,7 @@ void PortalComponent::UpdateAliensLifetime() {
 
 BallComponent::BallComponent(f32 x, f32 y, f32 w, f32 h, f32 r) {
     m_position = { x, y };
+    m_prevPosition = m_position;
     m_size = { w, h };
     m_velocity = INIT_VELOCITY;
     m_radius = r;
@@ -476,15 +736,18 @@ void BallComponent::Launch() {
 }
 
 void BallComponent::OnInit() {
-    m_textureId = g_gameState.res.Acquire("assets/doge.png");
+    m_textureId = g_gameState.resIds.atlas;
+    m_textureSrc = GetSpriteRect(SpriteId::Ball);
 }
 
 void BallComponent::Tick(f32 dt) {
+    m_prevPosition = m_position;
+
     PlayerComponent *playerComp = g_gameState.player->GetComponent<PlayerComponent>();
     Vector2 playerPosition = { 0, 0 };
     if (playerComp && m_state == State::Attached) {
         playerPosition = playerComp->GetPosition();
-        m_position = { playerPosition.x + 32.0f, m_position.y };
+        m_position = { playerPosition.x + 32.0f, g_gameState.worldDim.height - PlayerComponent::BOTTOM_OFFSET - SERVE_OFFSET };
     }
     else if (playerComp && m_state == State::Launched) {
         m_position += m_velocity * dt;
@@ -504,18 +767,25 @@ void BallComponent::Tick(f32 dt) {
         }
 
         if (m_position.y > g_gameState.worldDim.height) {
+            // extra balls are just lost, the round ends with the one the paddle serves
+            if (m_go != g_gameState.ball) {
+                g_gameState.collisionMgr.QueueRemove(CollidableType::Ball, m_go);
+                g_gameState.goMgr.QueueDestroy(m_go);
+                return;
+            }
             g_gameState.gameplayState = GameplayState::PreGameOver;
         }
     }
 
+    if (!g_gameState.visibility.IsVisible(m_position, m_prevPosition, m_size)) {
+        return;
+    }
+
     Texture2D texture = g_gameState.res.textures[m_textureId];
-    DrawItem drawItem = {};
-    drawItem.position = m_position;
-    drawItem.texture = g_gameState.res.textures[m_textureId];
-    drawItem.src = Rectangle{ 0, 0, (f32)texture.width, (f32)texture.height };
-    drawItem.size = m_size;
-    drawItem.z_index = 0;
-    DrawManager::Instance().Add(drawItem);
+    TextureDrawCmd cmd = CreateTextureDrawCmd(texture, m_textureSrc, m_position, m_size, DrawLayer::Default);
+    cmd.prevPosition = m_prevPosition;
+    cmd.interpolate = true;
+    DrawManager::Instance().Add(cmd);
 }
 
 void BallComponent::ResolvePlayerCollision(PlayerComponent *playerComp) {
@@ -580,29 +850,49 @@ void BallComponent::OnCollision(const CollisionManifold &manifold, GameObject *c
     g_gameState.hitScore++;
 }
 
+void BallComponent::OnSweptCollision(Vector2 center, Vector2 normal) {
+    SetCenter(center);
+
+    f32 speedAlongNormal = Vector2DotProduct(m_velocity, normal);
+    if (speedAlongNormal < 0.0f) {
+        m_velocity = Vector2Subtract(m_velocity, Vector2Scale(normal, 2.0f * speedAlongNormal));
+    }
+
+    g_gameState.hitScore++;
+}
+
 
 AlienComponent::AlienComponent(f32 x, f32 y, f32 w, f32 h, f32 r) {
     m_position = { x, y };
+    m_prevPosition = m_position;
     m_size = { w, h };
     m_radius = r;
 }
 
 void AlienComponent::OnInit() {
-    m_textureId = g_gameState.res.Acquire("assets/aliens.png");
-    const int maxTextures = 4;
-    Rectangle textureSrcs[maxTextures] = {
-        Rectangle{64, 0, 64, 64},
-        Rectangle{0, 448, 64, 64},
-        Rectangle{384, 448, 64, 64},
-        Rectangle{0, 0, 64, 64},
+    m_textureId = g_gameState.resIds.atlas;
+    // registered once, inactive aliens are skipped by the collision tests
+    g_gameState.collisionMgr.Add(CollidableType::Alien, m_go, Rectangle{});
+}
+
+void AlienComponent::Spawn(Vector2 position) {
+    m_position = position;
+    m_prevPosition = position;
+    m_fellDown = false;
+
+    const SpriteId sprites[] = {
+        SpriteId::Alien0,
+        SpriteId::Alien1,
+        SpriteId::Alien2,
+        SpriteId::Alien3,
     };
+    const int maxTextures = sizeof(sprites) / sizeof(sprites[0]);
 
-    m_textureSrc = textureSrcs[GetRandomValue(0, maxTextures - 1)];
+    m_textureSrc = GetSpriteRect(sprites[GetRandomValue(0, maxTextures - 1)]);
 
     auto *playerComp = g_gameState.player->GetComponent<PlayerComponent>();
     m_dir = Vector2Subtract(playerComp->GetPosition(), m_position);
     m_dir = Vector2Normalize(m_dir);
-    g_gameState.collisionMgr.Add(CollidableType::Alien, m_go, Rectangle{});
 }
 
 void AlienComponent::OnCollision() {
@@ -610,6 +900,7 @@ void AlienComponent::OnCollision() {
 }
 
 void AlienComponent::Tick(f32 dt) {
+    m_prevPosition = m_position;
     Vector2 velocity = Vector2Scale(m_dir, SPEED * dt);
     m_position = m_position + velocity;
 
@@ -618,93 +909,283 @@ void AlienComponent::Tick(f32 dt) {
         return;
     }
 
+    if (!g_gameState.visibility.IsVisible(m_position, m_prevPosition, m_size)) {
+        return;
+    }
+
     Texture2D texture = g_gameState.res.textures[m_textureId];
-    DrawItem drawItem = {};
-    drawItem.position = m_position;
-    drawItem.texture = texture;
-    drawItem.src = m_textureSrc;
-    drawItem.size = m_size;
-    drawItem.z_index = 100;
-    DrawManager::Instance().Add(drawItem);
+    TextureDrawCmd cmd = CreateTextureDrawCmd(texture, m_textureSrc, m_position, m_size, DrawLayer::Foreground);
+    cmd.prevPosition = m_prevPosition;
+    cmd.interpolate = true;
+    DrawManager::Instance().Add(cmd);
 }
 
-BlockComponent::BlockComponent(f32 x, f32 y, f32 width, f32 height) {
+BlockComponent::BlockComponent(f32 x, f32 y, f32 width, f32 height, int tileIndex) {
     m_position = { x, y };
+    m_prevPosition = m_position;
     m_size = { width, height };
+    m_tileIndex = tileIndex;
 }
 
 void BlockComponent::OnInit() {
     Vector2 center = GetCenter();
     Vector2 halfSize = { m_size.x * 0.5f, m_size.y * 0.5f };
-    m_textureId = g_gameState.res.Acquire("assets/tiles.png");
-    m_textureSrc = Rectangle{ 0, 0, 25, 25 };
 
     g_gameState.collisionMgr.Add(CollidableType::Block, m_go, Rectangle{ center.x, center.y, halfSize.x, halfSize.y });
 }
 
-void BlockComponent::Tick(f32) {
-    DrawItem drawItem = {};
-    drawItem.position = m_position;
-    drawItem.texture = g_gameState.res.textures[m_textureId];
-    drawItem.size = m_size;
-    drawItem.src = m_textureSrc;
-    drawItem.z_index = -999;
-    DrawManager::Instance().Add(drawItem);
+void BlockComponent::OnCollision(const CollisionManifold &manifold, GameObject *go) {
+    g_gameState.collisionMgr.QueueRemove(CollidableType::Block, m_go);
+    g_gameState.map->RemoveTile(m_tileIndex);
 }
 
-void BlockComponent::OnCollision(const CollisionManifold &manifold, GameObject *go) {
-    g_gameState.collisionMgr.Remove(CollidableType::Block, m_go);
+GameObject *CollisionManager::Resolve(const Collidable &collidable) {
+    return g_gameState.goMgr.Get(collidable.handle);
 }
 
 void CollisionManager::Add(CollidableType type, GameObject *go, Rectangle bounds) {
-    Collidable collidable = { go, bounds };
+    Collidable collidable = { go->GetHandle(), bounds };
     switch (type) {
     case CollidableType::Alien:
-        m_aliens.push_back(collidable);
+        m_aliens.Add(collidable);
         break;
     case CollidableType::Block:
-        m_blocks.push_back(collidable);
+        m_blocks.Add(collidable);
+        if (m_blockGrid.IsBuilt() && !m_blockGrid.Insert(ScaleAABB(bounds), collidable)) {
+            // block is outside of the current grid, grow it
+            BuildBlockGrid(m_blockGrid.cellSize, m_blockGridArea);
+        }
         break;
     case CollidableType::Ball:
-        m_balls.push_back(collidable);
+        m_balls.Add(collidable);
         break;
     }
 }
 
 void CollisionManager::Remove(CollidableType type, GameObject *go) {
+    Remove(type, go->GetHandle());
+}
+
+void CollisionManager::Remove(CollidableType type, GameObjectHandle handle) {
     switch (type) {
     case CollidableType::Alien:
-        RemoveCollidable(m_aliens, go);
+        m_aliens.Remove(handle);
         break;
     case CollidableType::Block:
-        RemoveCollidable(m_blocks, go);
+        if (const Collidable *block = m_blocks.Find(handle)) {
+            m_blockGrid.Remove(ScaleAABB(block->bounds), [handle](const Collidable &item) {
+                return item.handle == handle;
+            });
+        }
+        m_blocks.Remove(handle);
         break;
     case CollidableType::Ball:
-        RemoveCollidable(m_balls, go);
+        m_balls.Remove(handle);
         break;
     }
 }
 
-void CollisionManager::RemoveCollidable(std::vector<Collidable> &collidable, GameObject *testGo) {
-    if (collidable.empty()) {
+void CollisionManager::QueueRemove(CollidableType type, GameObject *go) {
+    m_pendingRemovals.push_back(PendingRemoval{ type, go->GetHandle() });
+}
+
+void CollisionManager::ApplyRemovals() {
+    for (const auto &removal : m_pendingRemovals) {
+        Remove(removal.type, removal.handle);
+    }
+
+    m_pendingRemovals.clear();
+}
+
+void CollisionManager::BuildBlockGrid(Vector2 cellSize, Rectangle area) {
+    m_blockGrid.Clear();
+    m_blockGridArea = area;
+    if (!BLOCK_GRID || (m_blocks.items.empty() && (area.width <= 0.0f || area.height <= 0.0f))) {
         return;
     }
 
+    Vector2 min = { area.x, area.y };
+    Vector2 max = { area.x + area.width, area.y + area.height };
+    if (area.width <= 0.0f || area.height <= 0.0f) {
+        Rectangle first = ScaleAABB(m_blocks.items[0].bounds);
+        min = Vector2{ first.x, first.y };
+        max = Vector2{ first.x + first.width, first.y + first.height };
+    }
+    for (const auto &block : m_blocks.items) {
+        Rectangle bounds = ScaleAABB(block.bounds);
+        min = Vector2Min(min, Vector2{ bounds.x, bounds.y });
+        max = Vector2Max(max, Vector2{ bounds.x + bounds.width, bounds.y + bounds.height });
+    }
+
+    m_blockGrid.Init(Rectangle{ min.x, min.y, max.x - min.x, max.y - min.y }, cellSize);
+
+    for (const auto &block : m_blocks.items) {
+        bool inserted = m_blockGrid.Insert(ScaleAABB(block.bounds), block);
+        assert(inserted);
+        (void)inserted;
+    }
+}
+
+void CollisionManager::ReserveBlocks(u32 count) {
+    m_blocks.items.reserve(m_blocks.items.size() + count);
+}
+
+void CollisionManager::CollidableList::Add(const Collidable &collidable) {
+    u32 slot = collidable.handle.index;
+    if (slot >= indices.size()) {
+        indices.resize(slot + 1, NONE);
+    }
+
+    assert(indices[slot] == NONE && "Object is already in the list");
+    indices[slot] = static_cast<u32>(items.size());
+    items.push_back(collidable);
+    if (keepSoA) {
+        soa.Add(collidable.bounds);
+    }
+}
+
+CollisionManager::Collidable *CollisionManager::CollidableList::Find(GameObjectHandle handle) {
+    u32 slot = handle.index;
+    if (slot >= indices.size() || indices[slot] == NONE || items[indices[slot]].handle != handle) {
+        return nullptr;
+    }
+
+    return &items[indices[slot]];
+}
+
+bool CollisionManager::CollidableList::Remove(GameObjectHandle handle) {
+    if (!Find(handle)) {
+        return false;
+    }
+
     // don't care about sorting, should be faster than erase/remove
-    int destroyIdx = 0;
-    for (int i = 0; i < collidable.size(); ++i) {
-        if (testGo->GetId() == collidable[i].go->GetId()) {
-            destroyIdx = i;
+    u32 slot = handle.index;
+    u32 removeIdx = indices[slot];
+    indices[items.back().handle.index] = removeIdx;
+    RemoveByIndex(items, static_cast<int>(removeIdx));
+    if (keepSoA) {
+        soa.RemoveSwap(removeIdx);
+    }
+    indices[slot] = NONE;
+
+    return true;
+}
+
+void CollisionManager::CollidableList::Clear() {
+    items.clear();
+    soa.Clear();
+    std::fill(indices.begin(), indices.end(), NONE);
+}
+
+bool CollisionManager::CollideBallWithBlock(GameObject *ballGo, BallComponent *ballComp, Circle circle, Collidable block) {
+    // already hit this step, it stays in the lists until ApplyRemovals
+    GameObject *blockGo = Resolve(block);
+    assert(blockGo && "Block collidable outlived its object");
+    if (!blockGo || blockGo->IsQueuedForDestroy()) {
+        return false;
+    }
+
+    AABB aabb = {};
+    aabb.center = { block.bounds.x, block.bounds.y };
+    aabb.halfExtents = { block.bounds.width, block.bounds.height };
+    CollisionManifold manifold = AABBvsCircle(aabb, circle);
+
+    if (manifold.collides) {
+        BlockComponent *blockComp = blockGo->GetComponent<BlockComponent>();
+        ballComp->OnCollision(manifold, blockGo);
+        blockComp->OnCollision(manifold, ballGo);
+        g_gameState.goMgr.QueueDestroy(blockGo);
+    }
+
+    return manifold.collides;
+}
+
+void CollisionManager::SweepBall(Collidable &ball, GameObject *ballGo, BallComponent *ballComp, Vector2 start, Vector2 end) {
+    f32 radius = ballComp->GetRadius();
+    bool moved = false;
+
+    for (int bounce = 0; bounce < MAX_SWEPT_BOUNCES; ++bounce) {
+        Vector2 delta = Vector2Subtract(end, start);
+        Circle circle = { start, radius };
+
+        f32 hitToi = 2.0f;
+        Vector2 hitNormal = {};
+        f32 hitDepth = 0.0f;
+        GameObject *hitBlock = nullptr;
+        auto sweep = [&](const Collidable &block) {
+            GameObject *blockGo = Resolve(block);
+            assert(blockGo && "Block collidable outlived its object");
+            if (!blockGo || blockGo->IsQueuedForDestroy()) {
+                return false;
+            }
+
+            AABB aabb = { Vector2{ block.bounds.x, block.bounds.y }, Vector2{ block.bounds.width, block.bounds.height } };
+            f32 toi = 0.0f;
+            Vector2 normal = {};
+            f32 depth = 0.0f;
+            m_testsNum++;
+            if (SweptCircleVsAABB(aabb, circle, delta, toi, normal, depth) && toi < hitToi) {
+                hitToi = toi;
+                hitNormal = normal;
+                hitDepth = depth;
+                hitBlock = blockGo;
+            }
+
+            // keep going, the earliest hit wins
+            return false;
+        };
+
+        if (m_blockGrid.IsBuilt()) {
+            Rectangle area = {
+                std::min(start.x, end.x) - radius,
+                std::min(start.y, end.y) - radius,
+                fabsf(delta.x) + radius * 2.0f,
+                fabsf(delta.y) + radius * 2.0f
+            };
+            m_blockGrid.Query(area, sweep);
+        }
+        else {
+            for (const auto &block : m_blocks.items) {
+                sweep(block);
+            }
+        }
+
+        if (!hitBlock) {
             break;
         }
+
+        // stop just short of the contact and continue with the reflected remainder of the move. A ball which started
+        // inside the block is pushed out of it first
+        const f32 skin = 0.01f;
+        Vector2 contact = Vector2Add(Vector2Add(start, Vector2Scale(delta, hitToi)), Vector2Scale(hitNormal, hitDepth + skin));
+        Vector2 remainder = Vector2Scale(delta, 1.0f - hitToi);
+        remainder = Vector2Subtract(remainder, Vector2Scale(hitNormal, 2.0f * std::min(Vector2DotProduct(remainder, hitNormal), 0.0f)));
+
+        ballComp->OnSweptCollision(contact, hitNormal);
+        CollisionManifold manifold = {};
+        manifold.diff = Vector2Scale(hitNormal, -radius);
+        manifold.collides = true;
+        hitBlock->GetComponent<BlockComponent>()->OnCollision(manifold, ballGo);
+        g_gameState.goMgr.QueueDestroy(hitBlock);
+
+        start = contact;
+        end = Vector2Add(contact, remainder);
+        moved = true;
     }
 
-    RemoveByIndex(collidable, destroyIdx);
+    if (moved) {
+        ballComp->SetCenter(end);
+        ball.bounds.x = end.x;
+        ball.bounds.y = end.y;
+    }
 }
 
 void CollisionManager::Tick() {
 // NOTE: realistically there is always one ball. But if I decide to add some powerup that adds multiple balls, then this setup already works.
-// TODO: consider to have quad tree. For now this is fine since the number of game objects is small.
+// Static blocks are looked up through the uniform grid, only blocks in the cells around the ball are tested.
+    PROFILE_SCOPE("Collisions");
+
+    m_testsNum = 0;
 
     //1st test - dynamic bounds vs dynamic bounds
     PlayerComponent *playerComp = g_gameState.player->GetComponent<PlayerComponent>();
@@ -717,27 +1198,39 @@ void CollisionManager::Tick() {
 
         Rectangle bounds = { pos.x, pos.y, size.x, size.y };
         //player vs ball
-        for (auto &ball : m_balls) {
-            BallComponent *ballComp = ball.go->GetComponent<BallComponent>();
+        for (auto &ball : m_balls.items) {
+            GameObject *ballGo = Resolve(ball);
+            assert(ballGo && "Ball collidable outlived its object");
+            if (!ballGo) {
+                continue;
+            }
+            BallComponent *ballComp = ballGo->GetComponent<BallComponent>();
             Vector2 center = ballComp->GetCenter();
             f32 radius = ballComp->GetRadius();
             ball.bounds = Rectangle{ center.x, center.y, radius, radius };
 
             Circle circle = { center, radius };
             CollisionManifold manifold = AABBvsCircle(aabbPlayer, circle);
+            m_testsNum++;
             if (manifold.collides) {
                 ballComp->OnCollision(manifold, g_gameState.player);
             }
         }
         // player vs alien
-        for (auto &alien : m_aliens) {
+        for (auto &alien : m_aliens.items) {
             Rectangle bounds = { pos.x, pos.y, size.x, size.y };
-            AlienComponent *alienComp = alien.go->GetComponent<AlienComponent>();
+            GameObject *alienGo = Resolve(alien);
+            assert(alienGo && "Alien collidable outlived its object");
+            AlienComponent *alienComp = alienGo ? alienGo->GetComponent<AlienComponent>() : nullptr;
+            if (!alienComp || !alienComp->IsActive()) {
+                continue;
+            }
             Vector2 center = alienComp->GetCenter();
             f32 radius = alienComp->GetRadius();
             alien.bounds = Rectangle{ center.x, center.y, radius, radius };
             Circle circle = { center, radius };
             CollisionManifold manifold = AABBvsCircle(aabbPlayer, circle);
+            m_testsNum++;
             if (manifold.collides) {
                 // don't need manifold info for alien
                 alienComp->OnCollision();
@@ -747,28 +1240,104 @@ void CollisionManager::Tick() {
     }
 
     //2nd test - dynamic bounds vs static bounds. ball vs block
-    for (auto &ball : m_balls) {
-        BallComponent *ballComp = ball.go->GetComponent<BallComponent>();
+    bool contactsFound = false;
+#if JOB_SYSTEM
+    if (m_balls.items.size() > BALLS_PER_JOB && JobSystem::Instance().GetWorkersNum() > 0) {
+        FindBallContacts();
+        contactsFound = true;
+    }
+#endif
+
+    for (u32 b = 0; b < m_balls.items.size(); ++b) {
+        Collidable &ball = m_balls.items[b];
+        GameObject *ballGo = Resolve(ball);
+        if (!ballGo) {
+            continue;
+        }
+        BallComponent *ballComp = ballGo->GetComponent<BallComponent>();
         Vector2 center = { ball.bounds.x, ball.bounds.y };
         f32 radius = ball.bounds.width;
         Circle circle = { center, radius };
-        for (auto block : m_blocks) {
-            AABB aabb = {};
-            aabb.center = { block.bounds.x, block.bounds.y };
-            aabb.halfExtents = { block.bounds.width, block.bounds.height };
-            CollisionManifold manifold = AABBvsCircle(aabb, circle);
 
-            if (manifold.collides) {
-                BlockComponent *blockComp = block.go->GetComponent<BlockComponent>();
-                ballComp->OnCollision(manifold, block.go);
-                blockComp->OnCollision(manifold, ball.go);
-                g_gameState.goMgr.Destroy(block.go);
-                break;
+        // a fast ball could skip a block between two steps
+        Vector2 prevCenter = ballComp->GetPrevCenter();
+        f32 sweepDistance = radius * SWEEP_THRESHOLD;
+        if (Vector2LengthSqr(Vector2Subtract(center, prevCenter)) > sweepDistance * sweepDistance) {
+            SweepBall(ball, ballGo, ballComp, prevCenter, center);
+        }
+        else if (contactsFound && !m_ballContacts[b].overflow) {
+            const BallContacts &contacts = m_ballContacts[b];
+            m_testsNum += contacts.testsNum;
+            for (u32 i = 0; i < contacts.count; ++i) {
+                if (CollideBallWithBlock(ballGo, ballComp, circle, contacts.blocks[i])) {
+                    break;
+                }
             }
         }
+        else {
+            QueryBlocks(circle, m_testsNum, [&](const Collidable &block) {
+                return CollideBallWithBlock(ballGo, ballComp, circle, block);
+            });
+        }
     }
 }
 
+template <typename Fn>
+void CollisionManager::QueryBlocks(Circle circle, u32 &testsNum, Fn &&fn) {
+    if (m_blockGrid.IsBuilt()) {
+        Rectangle area = { circle.center.x - circle.radius, circle.center.y - circle.radius, circle.radius * 2.0f, circle.radius * 2.0f };
+        // a hit block stays in its cells until ApplyRemovals, CollideBallWithBlock skips it once it's queued for destroy
+        m_blockGrid.Query(area, [&](const Collidable &block) {
+            testsNum++;
+            return fn(block);
+        });
+        return;
+    }
+
+    // SIMD prefilter over all blocks, a candidate which was already hit this step is skipped
+    assert(m_blocks.keepSoA || m_blocks.items.empty());
+    AABBBatchHit hit = CircleVsAABBs(m_blocks.soa, 0, circle);
+    testsNum += hit.testsNum;
+    while (hit.first >= 0 && !fn(m_blocks.items[hit.first])) {
+        hit = CircleVsAABBs(m_blocks.soa, hit.first + 1, circle);
+        testsNum += hit.testsNum;
+    }
+}
+
+void CollisionManager::FindBallContacts() {
+    u32 ballsNum = static_cast<u32>(m_balls.items.size());
+    m_ballContacts.resize(ballsNum);
+
+    // the balls which get swept are looked up too, their contacts aren't used
+    u32 jobsNum = (ballsNum + BALLS_PER_JOB - 1) / BALLS_PER_JOB;
+    JobSystem::Instance().ParallelFor(jobsNum, [this, ballsNum](u32 job) {
+        u32 end = std::min((job + 1) * BALLS_PER_JOB, ballsNum);
+        for (u32 b = job * BALLS_PER_JOB; b < end; ++b) {
+            const Collidable &ball = m_balls.items[b];
+            Circle circle = { Vector2{ ball.bounds.x, ball.bounds.y }, ball.bounds.width };
+
+            BallContacts &contacts = m_ballContacts[b];
+            contacts.count = 0;
+            contacts.testsNum = 0;
+            contacts.overflow = false;
+            QueryBlocks(circle, contacts.testsNum, [&](const Collidable &block) {
+                AABB aabb = { Vector2{ block.bounds.x, block.bounds.y }, Vector2{ block.bounds.width, block.bounds.height } };
+                if (!AABBvsCircle(aabb, circle).collides) {
+                    return false;
+                }
+
+                if (contacts.count == MAX_BALL_CONTACTS) {
+                    contacts.overflow = true;
+                    return true;
+                }
+                contacts.blocks[contacts.count++] = block;
+
+                return false;
+            });
+        }
+    });
+}
+
 void CollisionManager::DebugDraw() {
     PlayerComponent *playerComp = g_gameState.player->GetComponent<PlayerComponent>();
     Vector2 pos = playerComp->GetPosition();
@@ -777,24 +1346,31 @@ void CollisionManager::DebugDraw() {
     
     DrawRectangleLinesEx(bounds, 2.0f, RED);
 
-    for (const auto &ball : m_balls) {
+    for (const auto &ball : m_balls.items) {
         DrawCircleLinesV(Vector2{ ball.bounds.x, ball.bounds.y }, ball.bounds.width, RED);
     }
 
-    for (const auto &alien : m_aliens) {
+    for (const auto &alien : m_aliens.items) {
+        GameObject *alienGo = Resolve(alien);
+        if (!alienGo || !alienGo->GetComponent<AlienComponent>()->IsActive()) {
+            continue;
+        }
         DrawCircleLinesV(Vector2{ alien.bounds.x, alien.bounds.y }, alien.bounds.width, RED);
     }
 
-    for (const auto &block : m_blocks) {
+    for (const auto &block : m_blocks.items) {
         auto bounds = ScaleAABB(block.bounds);
         DrawRectangleLinesEx(bounds, 2.0f, RED);
     }
 }
 
 void CollisionManager::Clear() {
-    m_balls.clear();
-    m_blocks.clear();
-    m_aliens.clear();
+    m_balls.Clear();
+    m_blocks.Clear();
+    m_aliens.Clear();
+    m_blockGrid.Clear();
+    m_blockGridArea = Rectangle{};
+    m_pendingRemovals.clear();
 }
 
 Map::Map(Vector2 origin, Vector2 tileSize, int width, int height) :
@@ -823,24 +1399,354 @@ Vector2 Map::GetOrigin() const {
     return origin;
 }
 
-void Map::Load(u8 *data) {
-    f32 xoffset = m_origin.x;
-    f32 yoffset = m_origin.y;
-    const int padding = 5.0f;
+Map::~Map() {
+    // the map can be destroyed by the simulation thread, gl calls belong to the main one
+    if (m_blockLayer.id != 0) {
+        g_gameState.pendingUnloads.Add(m_blockLayer);
+    }
+    if (m_retiredBlockLayer.id != 0) {
+        g_gameState.pendingUnloads.Add(m_retiredBlockLayer);
+    }
+}
+
+Vector2 Map::GetTilePosition(int x, int y) const {
+    // rows grow upwards from the origin
+    Vector2 position = {
+        m_origin.x + x * (m_tileSize.x + PADDING),
+        m_origin.y - y * (m_tileSize.y + PADDING)
+    };
+
+    return position;
+}
+
+Rectangle Map::GetFieldBounds() const {
+    Vector2 topLeft = GetTilePosition(0, m_height - 1);
+    Rectangle bounds = {
+        topLeft.x,
+        topLeft.y,
+        m_width * (m_tileSize.x + PADDING) - PADDING,
+        m_height * (m_tileSize.y + PADDING) - PADDING
+    };
+
+    return bounds;
+}
+
+void Map::Load(const LevelData &level) {
+    assert(level.width == m_width && level.height == m_height);
+
+    // one pass over the runs fills the tiles and counts them per row, empty runs are skipped whole
+    m_tiles.assign(m_width * m_height, 0);
+    m_rowTiles.assign(m_height, 0);
+    m_blocksNum = 0;
+    ForEachTileRun(level, [this](int first, int count, u8 tile) {
+        if (tile == 0) {
+            return;
+        }
+
+        memset(m_tiles.data() + first, tile, count);
+        for (int index = first; index < first + count; ++index) {
+            m_rowTiles[index / m_width]++;
+        }
+        m_blocksNum += count;
+    });
+    m_tilesLeft = m_blocksNum;
+    assert(m_blocksNum == level.blocksNum && "Level block count doesn't match its tiles");
+
+    m_chunks.assign((m_height + CHUNK_ROWS - 1) / CHUNK_ROWS, Chunk{});
     for (int y = 0; y < m_height; ++y) {
-        for (int x = 0; x < m_width; ++x) {
-            int index = (y * m_width) + x;
-            bool isTileEmpty = data[index] == 0;
-            if (!isTileEmpty) {
-                GameObject *tile = g_gameState.goMgr.Create();
-                tile->AddComponent<BlockComponent>(xoffset, yoffset, m_tileSize.x, m_tileSize.y);
-                m_blocksNum++;
-           }
-           xoffset += m_tileSize.x + padding;
+        m_chunks[y / CHUNK_ROWS].tilesNum += m_rowTiles[y];
+    }
+
+    m_lowestRow = 0;
+    while (m_lowestRow < m_height && m_rowTiles[m_lowestRow] == 0) {
+        m_lowestRow++;
+    }
+
+    StreamChunks(g_gameState.worldDim);
+
+    // one grid cell per tile, padding included. It spans the whole field, chunks activated later don't grow it
+    g_gameState.collisionMgr.BuildBlockGrid(Vector2{ m_tileSize.x + PADDING, m_tileSize.y + PADDING }, GetFieldBounds());
+
+#if !HEADLESS
+    // the render texture is created by the first refresh, until then blocks draw themselves
+    Rectangle field = GetFieldBounds();
+    if (field.width <= MAX_BLOCK_LAYER_SIZE && field.height <= MAX_BLOCK_LAYER_SIZE) {
+        m_blockLayerState = BlockLayerState::NeedsFullRender;
+    }
+#endif
+}
+
+void Map::RemoveTile(int index) {
+    assert(index >= 0 && index < (int)m_tiles.size() && m_tiles[index] != 0);
+    m_tiles[index] = 0;
+
+    int x = index % m_width;
+    int y = index / m_width;
+    m_rowTiles[y]--;
+    m_chunks[y / CHUNK_ROWS].tilesNum--;
+    m_tilesLeft--;
+    while (m_lowestRow < m_height && m_rowTiles[m_lowestRow] == 0) {
+        m_lowestRow++;
+    }
+
+    if (m_dirtyMinX > m_dirtyMaxX) {
+        m_dirtyMinX = m_dirtyMaxX = x;
+        m_dirtyMinY = m_dirtyMaxY = y;
+    }
+    else {
+        m_dirtyMinX = std::min(m_dirtyMinX, x);
+        m_dirtyMinY = std::min(m_dirtyMinY, y);
+        m_dirtyMaxX = std::max(m_dirtyMaxX, x);
+        m_dirtyMaxY = std::max(m_dirtyMaxY, y);
+    }
+}
+
+bool Map::GetRowRange(f32 minY, f32 maxY, int &first, int &last) const {
+    // rows grow upwards, the top of row y is at origin.y - y * step and the row is tileSize.y tall
+    f32 step = m_tileSize.y + PADDING;
+    first = std::max(0, (int)ceilf((m_origin.y - maxY) / step));
+    last = std::min(m_height - 1, (int)floorf((m_origin.y + m_tileSize.y - minY) / step));
+
+    return first <= last;
+}
+
+bool Map::GetColumnRange(f32 minX, f32 maxX, int &first, int &last) const {
+    f32 step = m_tileSize.x + PADDING;
+    first = std::max(0, (int)floorf((minX - m_origin.x - m_tileSize.x) / step) + 1);
+    last = std::min(m_width - 1, (int)ceilf((maxX - m_origin.x) / step) - 1);
+
+    return first <= last;
+}
+
+bool Map::GetChunkRange(f32 minY, f32 maxY, int &first, int &last) const {
+    int firstRow = 0;
+    int lastRow = 0;
+    if (!GetRowRange(minY, maxY, firstRow, lastRow)) {
+        return false;
+    }
+
+    first = firstRow / CHUNK_ROWS;
+    last = lastRow / CHUNK_ROWS;
+
+    return true;
+}
+
+void Map::StreamChunks(Rectangle view) {
+    PROFILE_SCOPE("Streaming");
+
+    int first = 0;
+    int last = -1;
+    bool visible = GetChunkRange(view.y, view.height, first, last);
+
+    // a view outside of the field keeps nothing
+    int keepFirst = visible ? first - STREAM_MARGIN_CHUNKS * 2 : 0;
+    int keepLast = visible ? last + STREAM_MARGIN_CHUNKS * 2 : -1;
+    for (size_t i = 0; i < m_residentChunks.size();) {
+        int chunk = m_residentChunks[i].chunk;
+        if (chunk < keepFirst || chunk > keepLast) {
+            EvictChunk(static_cast<int>(i));
+            continue;
+        }
+        ++i;
+    }
+
+    if (!visible) {
+        return;
+    }
+
+    int chunksNum = static_cast<int>(m_chunks.size());
+    for (int chunk = std::max(0, first - STREAM_MARGIN_CHUNKS); chunk <= std::min(chunksNum - 1, last + STREAM_MARGIN_CHUNKS); ++chunk) {
+        if (m_chunks[chunk].resident < 0 && m_chunks[chunk].tilesNum > 0) {
+            ActivateChunk(chunk);
+        }
+    }
+}
+
+void Map::ActivateChunk(int chunk) {
+    Chunk &info = m_chunks[chunk];
+    assert(info.resident < 0);
+
+    ResidentChunk resident;
+    resident.chunk = chunk;
+    if (!m_spareBlockLists.empty()) {
+        resident.blocks = std::move(m_spareBlockLists.back());
+        m_spareBlockLists.pop_back();
+    }
+    resident.blocks.reserve(info.tilesNum);
+
+    int index = chunk * CHUNK_ROWS * m_width;
+    g_gameState.collisionMgr.ReserveBlocks(info.tilesNum);
+    g_gameState.goMgr.CreateBatch<BlockComponent>(info.tilesNum, [this, &index, &resident](GameObject *go, u32) {
+        while (m_tiles[index] == 0) {
+            index++;
+        }
+
+        Vector2 position = GetTilePosition(index % m_width, index / m_width);
+        go->AddComponent<BlockComponent>(position.x, position.y, m_tileSize.x, m_tileSize.y, index);
+        resident.blocks.push_back(go->GetHandle());
+        index++;
+    });
+
+    info.resident = static_cast<int>(m_residentChunks.size());
+    m_residentChunks.push_back(std::move(resident));
+}
+
+void Map::EvictChunk(int resident) {
+    ResidentChunk &evicted = m_residentChunks[resident];
+    for (GameObjectHandle handle : evicted.blocks) {
+        // blocks hit since the activation are gone already, their tiles too
+        if (GameObject *go = g_gameState.goMgr.Get(handle)) {
+            g_gameState.collisionMgr.Remove(CollidableType::Block, go);
+            g_gameState.goMgr.Destroy(go);
+        }
+    }
+
+    evicted.blocks.clear();
+    m_spareBlockLists.push_back(std::move(evicted.blocks));
+    m_chunks[evicted.chunk].resident = -1;
+
+    // swap with the last one
+    if (resident != static_cast<int>(m_residentChunks.size()) - 1) {
+        evicted = std::move(m_residentChunks.back());
+        m_chunks[evicted.chunk].resident = resident;
+    }
+    m_residentChunks.pop_back();
+}
+
+void Map::DrawTiles(int x0, int y0, int x1, int y1) {
+    Texture2D texture = g_gameState.res.textures[g_gameState.resIds.atlas];
+    Rectangle field = GetFieldBounds();
+
+    for (int y = y0; y <= y1; ++y) {
+        for (int x = x0; x <= x1; ++x) {
+            if (m_tiles[(y * m_width) + x] == 0) {
+                continue;
+            }
+
+            Vector2 position = GetTilePosition(x, y);
+            DrawTexturePro(texture,
+                BlockComponent::TEXTURE_SRC,
+                Rectangle{ position.x - field.x, position.y - field.y, m_tileSize.x, m_tileSize.y },
+                Vector2{ 0, 0 },
+                0.0f,
+                WHITE);
+        }
+    }
+}
+
+void Map::RefreshBlockLayer(f32 renderScale) {
+    if (m_blockLayerState == BlockLayerState::Disabled) {
+        return;
+    }
+
+    Rectangle field = GetFieldBounds();
+    // a big field at a high render scale would need a texture over the size limit
+    f32 maxScale = MAX_BLOCK_LAYER_SIZE / std::max(field.width, field.height);
+    f32 scale = std::min(renderScale, maxScale);
+
+    if (m_blockLayer.id != 0 && scale != m_blockLayerScale && m_retiredBlockLayer.id == 0) {
+        m_retiredBlockLayer = m_blockLayer;
+        m_blockLayer = {};
+        m_blockLayerState = BlockLayerState::NeedsFullRender;
+    }
+
+    Camera2D layerCamera = {};
+    layerCamera.zoom = m_blockLayerScale;
+
+    switch (m_blockLayerState) {
+    case BlockLayerState::Disabled:
+        return;
+    case BlockLayerState::NeedsFullRender: {
+        if (m_blockLayer.id == 0) {
+            m_blockLayerScale = scale;
+            layerCamera.zoom = scale;
+            m_blockLayer = LoadRenderTexture((int)ceilf(field.width * scale), (int)ceilf(field.height * scale));
+        }
+
+        BeginTextureMode(m_blockLayer);
+        ClearBackground(BLANK);
+        BeginMode2D(layerCamera);
+        DrawTiles(0, 0, m_width - 1, m_height - 1);
+        EndMode2D();
+        EndTextureMode();
+
+        m_blockLayerState = BlockLayerState::Ready;
+        break;
+    }
+    case BlockLayerState::Ready: {
+        if (m_dirtyMinX > m_dirtyMaxX) {
+            break;
+        }
+
+        // rows grow upwards, the top of the dirty area is the highest row
+        Vector2 topLeft = GetTilePosition(m_dirtyMinX, m_dirtyMaxY);
+        Vector2 bottomRight = GetTilePosition(m_dirtyMaxX, m_dirtyMinY) + m_tileSize;
+
+        BeginTextureMode(m_blockLayer);
+        BeginScissorMode((int)floorf((topLeft.x - field.x) * m_blockLayerScale), (int)floorf((topLeft.y - field.y) * m_blockLayerScale),
+            (int)ceilf((bottomRight.x - topLeft.x) * m_blockLayerScale), (int)ceilf((bottomRight.y - topLeft.y) * m_blockLayerScale));
+        ClearBackground(BLANK);
+        BeginMode2D(layerCamera);
+        DrawTiles(m_dirtyMinX, m_dirtyMinY, m_dirtyMaxX, m_dirtyMaxY);
+        EndMode2D();
+        EndScissorMode();
+        EndTextureMode();
+        break;
+    }
+    }
+
+    m_dirtyMinX = m_dirtyMinY = 0;
+    m_dirtyMaxX = m_dirtyMaxY = -1;
+}
+
+void Map::SubmitBlocks() {
+    PROFILE_SCOPE("SubmitBlocks");
+
+    Visibility &visibility = g_gameState.visibility;
+    if (m_blockLayerState != BlockLayerState::Ready) {
+        // the tiles are the spatial index, the ones outside of the view aren't even looked at
+        Rectangle view = visibility.GetView();
+        int x0 = 0, y0 = 0, x1 = -1, y1 = -1;
+        u32 visibleNum = 0;
+        if (GetColumnRange(view.x, view.x + view.width, x0, x1) && GetRowRange(view.y, view.y + view.height, y0, y1)) {
+            Texture2D texture = g_gameState.res.textures[g_gameState.resIds.atlas];
+            for (int y = y0; y <= y1; ++y) {
+                if (m_rowTiles[y] == 0) {
+                    continue;
+                }
+
+                for (int x = x0; x <= x1; ++x) {
+                    if (m_tiles[(y * m_width) + x] == 0) {
+                        continue;
+                    }
+
+                    DrawManager::Instance().Add(CreateTextureDrawCmd(texture, BlockComponent::TEXTURE_SRC, GetTilePosition(x, y), m_tileSize, DrawLayer::Background));
+                    visibleNum++;
+                }
+            }
         }
-        yoffset -= m_tileSize.y + padding;
-        xoffset = m_origin.x;
+
+        visibility.Count(visibleNum, m_tilesLeft - visibleNum);
+        return;
+    }
+
+    // the lists built from now on use the new layer, the old one goes once they are presented
+    if (m_retiredBlockLayer.id != 0) {
+        g_gameState.pendingUnloads.Add(m_retiredBlockLayer);
+        m_retiredBlockLayer = {};
+    }
+
+    Rectangle field = GetFieldBounds();
+    if (!visibility.IsVisible(field)) {
+        return;
     }
+
+    Texture2D texture = m_blockLayer.texture;
+
+    // render textures are stored upside down
+    Rectangle src = { 0, (f32)texture.height, (f32)texture.width, -(f32)texture.height };
+    Vector2 size = { texture.width / m_blockLayerScale, texture.height / m_blockLayerScale };
+    DrawManager::Instance().Add(CreateTextureDrawCmd(texture, src, Vector2{ field.x, field.y }, size, DrawLayer::Background));
 }
 
 void HUD::Init(View parent, ResHandle fontHandle) {
@@ -850,46 +1756,140 @@ void HUD::Init(View parent, ResHandle fontHandle) {
 }
 
 void HUD::Draw() {
+    PROFILE_SCOPE("HUD");
+
     Font font = g_gameState.res.fonts[fontId];
-    DrawTextEx(font,
-        TextFormat("Score: %d", g_gameState.hitScore),
-        Vector2{ text.xpos, text.ypos }, font.baseSize,
-        1.0f, WHITE);
+    if (shownScore != g_gameState.drawSnapshot.hitScore) {
+        shownScore = g_gameState.drawSnapshot.hitScore;
+        snprintf(scoreText, sizeof(scoreText), "Score: %d", shownScore);
+    }
+
+    TextCache::Instance().Draw(font, scoreText, Vector2{ text.xpos, text.ypos }, (f32)font.baseSize, 1.0f, WHITE);
 
 #if DEVELOPER
+    TextCache::Instance().Draw(font,
+        TextFormat("Allocs: %llu", (unsigned long long)g_gameState.drawSnapshot.stepHeapAllocations),
+        Vector2{ text.xpos, text.ypos + font.baseSize }, font.baseSize * 0.5f,
+        1.0f, WHITE);
     DrawRectangleLinesEx(Rectangle{ container.xpos, container.ypos, container.width, container.height }, 2.0f, RED);
 #endif
 
 }
 
+//NOTE: levels taller than the view scroll. The view follows the lowest row with tiles left, once a row is cleared
+// it moves up by a row at SCROLL_SPEED, and it stops where the top of the field is FIELD_TOP_MARGIN below its top.
+// A level that fits never scrolls. worldDim moves with the camera, everything bounded by it follows the view.
+static constexpr f32 SCROLL_SPEED = 120.0f;
+static constexpr f32 FIELD_TOP_MARGIN = 200.0f;
+
+// scroll is the camera target y, 0 is the view a level starts with
+static
+void SetViewScroll(f32 scroll) {
+    g_gameState.camera.target.y = scroll;
+    g_gameState.worldDim.y = globals::appSettings.screenHeight * -0.5f + scroll;
+    g_gameState.worldDim.height = globals::appSettings.screenHeight * 0.5f + scroll;
+}
+
+static
+void ScrollView(f32 dt) {
+    const Map *map = g_gameState.map;
+    int lowestRow = std::min(map->GetLowestRow(), map->GetHeight() - 1);
+    f32 fieldTop = map->GetTilePosition(0, map->GetHeight() - 1).y;
+    f32 minScroll = std::min(0.0f, fieldTop - FIELD_TOP_MARGIN - globals::appSettings.screenHeight * -0.5f);
+    f32 target = std::max(minScroll, map->GetTilePosition(0, lowestRow).y - map->GetTilePosition(0, 0).y);
+
+    // the view only moves up, targets only get lower as rows are cleared
+    f32 scroll = g_gameState.camera.target.y;
+    if (scroll > target) {
+        SetViewScroll(std::max(target, scroll - SCROLL_SPEED * dt));
+    }
+}
+
+// what the camera shows between the last step and this one, the frames in between interpolate
+static
+Rectangle GetStepView() {
+    Vector2 screenSize = { globals::appSettings.screenWidth, globals::appSettings.screenHeight };
+    Camera2D prevCamera = g_gameState.camera;
+    prevCamera.target = g_gameState.prevCameraTarget;
+
+    Rectangle view = GetCameraView(g_gameState.camera, screenSize);
+    Rectangle prevView = GetCameraView(prevCamera, screenSize);
+    f32 minX = std::min(view.x, prevView.x);
+    f32 minY = std::min(view.y, prevView.y);
+    f32 maxX = std::max(view.x + view.width, prevView.x + prevView.width);
+    f32 maxY = std::max(view.y + view.height, prevView.y + prevView.height);
+
+    return Rectangle{ minX, minY, maxX - minX, maxY - minY };
+}
+
 static
 void DestroyScene() {
     g_gameState.goMgr.Destroy();
+    g_gameState.alienPool.Clear();
     delete g_gameState.map;
+    g_gameState.map = nullptr;
     g_gameState.player = nullptr;
     g_gameState.ball = nullptr;
     g_gameState.hitScore = 0;
-    g_gameState.recordedDrawings.textureItems.clear();
-    g_gameState.recordedDrawings.fontItems.clear();
     g_gameState.resetTimer = 0;
     g_gameState.collisionMgr.Clear();
+    SetViewScroll(0.0f);
 
     g_gameState.menu.InitStartMenu(g_gameState.mainView);
     g_gameState.gameplayState = GameplayState::RunMenu;
 }
 
+// the map origin from the top-left of the world, rows grow upwards from it
+static constexpr Vector2 MAP_OFFSET = { 200.0f, 400.0f };
+
 static
-void InitScene() {
+void InitScene(const LevelData &level) {
 
     g_gameState.player = g_gameState.goMgr.Create();
-    g_gameState.player->AddComponent<PlayerComponent>(-16.0f, g_gameState.worldDim.height - 40.0f, PlayerComponent::WIDTH, PlayerComponent::HEIGHT);
+    g_gameState.player->AddComponent<PlayerComponent>(-16.0f, g_gameState.worldDim.height - PlayerComponent::BOTTOM_OFFSET, PlayerComponent::WIDTH, PlayerComponent::HEIGHT);
 
     g_gameState.ball = g_gameState.goMgr.Create();
-    g_gameState.ball->AddComponent<BallComponent>(0.0f, g_gameState.worldDim.height - 110.0f, BallComponent::WIDTH, BallComponent::HEIGHT, BallComponent::RADIUS);
+    g_gameState.ball->AddComponent<BallComponent>(0.0f, g_gameState.worldDim.height - PlayerComponent::BOTTOM_OFFSET - BallComponent::SERVE_OFFSET,
+        BallComponent::WIDTH, BallComponent::HEIGHT, BallComponent::RADIUS);
 
     auto *portal = g_gameState.goMgr.Create();
     portal->AddComponent<PortalComponent>();
 
+    // a whole wave up front, spawning mid game doesn't create anything
+    g_gameState.alienPool.Prewarm(g_gameState.goMgr, PortalComponent::MAX_ALIENS, [](GameObject *go) {
+        go->AddComponent<AlienComponent>(0.0f, 0.0f, AlienComponent::SIZE, AlienComponent::SIZE, AlienComponent::RADIUS);
+    });
+
+    Vector2 originMap = { g_gameState.worldDim.x + MAP_OFFSET.x, g_gameState.worldDim.y + MAP_OFFSET.y };
+    g_gameState.map = new Map(originMap, level.tileSize, level.width, level.height);
+    g_gameState.map->Load(level);
+}
+
+// an extra ball in play next to g_gameState.ball, for multiball. It's destroyed once it falls out
+static
+GameObject *SpawnBall(Vector2 center, Vector2 velocity) {
+    GameObject *go = g_gameState.goMgr.Create();
+    go->AddComponent<BallComponent>(center.x - BallComponent::RADIUS, center.y - BallComponent::RADIUS,
+        BallComponent::WIDTH, BallComponent::HEIGHT, BallComponent::RADIUS);
+
+    BallComponent *ballComp = go->GetComponent<BallComponent>();
+    ballComp->SetVelocity(velocity);
+    ballComp->Launch();
+
+    return go;
+}
+
+static
+void InitScene() {
+    MappedFile file;
+    LevelData level;
+    if (file.Open(FIRST_LEVEL_FILE) && ParseLevel(file.GetData(), file.GetSize(), level)) {
+        InitScene(level);
+        return;
+    }
+
+    TraceLog(LOG_WARNING, "LEVEL: Failed to load %s, using the built-in level", FIRST_LEVEL_FILE);
+
     const int width = 9;
     const int height = 3;
     u8 tiles[width * height] = {
@@ -898,13 +1898,12 @@ void InitScene() {
         1, 1, 1, 1, 0, 0, 1, 1, 0,
     };
 
-    Vector2 originMap = { g_gameState.worldDim.x + 200.0f, g_gameState.worldDim.y + 400.0f };
-    g_gameState.map = new Map(originMap, Vector2{ 128, 64 }, width, height);
-    g_gameState.map->Load(tiles);
+    InitScene(MakeLevel(tiles, width, height, Vector2{ 128, 64 }));
 }
 
-void Initialize() {
-    SetRandomSeed(time(NULL));
+// seed is the only randomness of the simulation, a replay runs with the recorded one
+void Initialize(u32 seed) {
+    SetRandomSeed(seed);
     g_gameState.mainView = View::Push(0, 0, globals::appSettings.screenWidth, globals::appSettings.screenHeight);
     g_gameState.worldDim.x = globals::appSettings.screenWidth * -0.5f;
     g_gameState.worldDim.y = globals::appSettings.screenHeight * -0.5f;
@@ -915,37 +1914,54 @@ void Initialize() {
     g_gameState.camera.target = { 0,0 };
     g_gameState.camera.rotation = 0.0f;
     g_gameState.camera.zoom = 1.0f;
+    g_gameState.prevCameraTarget = g_gameState.camera.target;
 
-    g_gameState.res.LoadTexture("assets/menu_bg.png");
-    g_gameState.res.LoadTexture("assets/bg.png");
-    g_gameState.res.LoadTexture("assets/tiles.png");
-    g_gameState.res.LoadTexture("assets/doge.png");
-    g_gameState.res.LoadTexture("assets/Portal.png");
-    g_gameState.res.LoadTexture("assets/aliens.png");
-    
-    auto fontHandle = g_gameState.res.LoadFont("assets/nicefont.ttf", 72); // probably not
+    g_gameState.time = 0.0;
+    g_gameState.checksum = HASH_SEED;
+
+    // 4MB per buffer fits the draw lists of a 64x64 level with plenty to spare
+    g_gameState.frameArena.Init(4 * 1024 * 1024);
+    DrawManager::Instance().SetFrameArena(&g_gameState.frameArena);
+
+#if JOB_SYSTEM
+    // the main thread runs jobs too
+    u32 hardwareThreads = std::thread::hardware_concurrency();
+    JobSystem::Instance().Init(hardwareThreads > 1 ? hardwareThreads - 1 : 0);
+#endif
+
+#if !HEADLESS
+    // decoded in the background, the menu shows up right away and the game starts once everything is uploaded
+    Resources &res = g_gameState.res;
+    g_gameState.resIds.menuBackground = res.Acquire(res.RequestTexture("assets/menu_bg.png"));
+    auto fontHandle = res.RequestFont("assets/nicefont.ttf", 72);
+    g_gameState.resIds.font = res.Acquire(fontHandle);
+    g_gameState.resIds.background = res.Acquire(res.RequestTexture("assets/bg.png"));
+    // every gameplay sprite, see assets/atlas.txt
+    g_gameState.resIds.atlas = res.Acquire(res.RequestTexture(SPRITE_ATLAS_FILE));
 
     g_gameState.hud.Init(g_gameState.mainView, fontHandle);
+#endif
     g_gameState.goMgr.Init();
+    g_gameState.assetsReady = g_gameState.res.GetLoadProgress().IsDone();
 
     g_gameState.gameplayState = GameplayState::RunMenu;
     g_gameState.menu.InitStartMenu(g_gameState.mainView);
 }
 
 static
-void PostGameResultMessage(const std::string &text, Color color) {
+void PostGameResultMessage(const char *text, Color color) {
 
     DrawItem item;
-    item.type = DrawItemType::Font;
     item.position = { g_gameState.worldDim.x + 200.0f, g_gameState.worldDim.y + 200.0f };
-    item.font = g_gameState.res.fonts[g_gameState.res.Acquire("assets/nicefont.ttf")];
+    item.font = g_gameState.res.fonts[g_gameState.resIds.font];
     item.spacing = 1.0f;
     item.size = Vector2{ 144.0f, 144.0f };
     item.text = text;
 
     item.color = color;
 
-    DrawManager::Instance().Copy(g_gameState.recordedDrawings);
+    // on top of the frozen lists of the last game step
+    DrawManager::Instance().Freeze();
     DrawManager::Instance().Add(item);
 }
 
@@ -953,71 +1969,76 @@ static
 void UpdateGame(f32 dt) {
     switch (g_gameState.gameplayState) {
     case GameplayState::RunGame:
-        if (IsKeyPressed(KEY_ESCAPE)) {
+        if (g_gameState.input.IsKeyPressed(KEY_ESCAPE)) {
             g_gameState.menu.InitResumeMenu(g_gameState.mainView);
             g_gameState.gameplayState = GameplayState::RunMenu;
         }
 
+        // the view moves first, the blocks around it exist before anything ticks
+        ScrollView(dt);
+        g_gameState.map->StreamChunks(g_gameState.worldDim);
+
+        // draw items are rebuilt by every step, only the latest one is rendered
+        DrawManager::Instance().Flush();
+        g_gameState.visibility.Begin(GetStepView());
+        g_gameState.map->SubmitBlocks();
         g_gameState.goMgr.Tick(dt);
         g_gameState.collisionMgr.Tick();
+        PROFILE_COUNTER("Visible", g_gameState.visibility.GetVisibleNum());
+        PROFILE_COUNTER("Culled", g_gameState.visibility.GetCulledNum());
+
+        // nothing is removed while the lists above are walked, kills are applied in one batch
+        g_gameState.collisionMgr.ApplyRemovals();
+        g_gameState.goMgr.DestroyQueued();
 
         if (g_gameState.map->GetBlocksNum() == g_gameState.hitScore) {
             g_gameState.gameplayState = GameplayState::PreGameWin;
         }
 
         break;
-    case GameplayState::GameOver: {
-
-        f32 currTime = GetTime();
-        if (currTime - g_gameState.resetTimer > GAME_RESET_DIFF) {
-            DestroyScene();
-            break;
-        }
-
-        PostGameResultMessage(R"(
-                Critical
-                failure)", RED);
-
-        break;
-    }
+    case GameplayState::GameOver:
     case GameplayState::GameWin: {
-        f32 currTime = GetTime();
+        // the draw lists aren't flushed anymore, the last game frame stays on screen
+        f32 currTime = (f32)g_gameState.time;
         if (currTime - g_gameState.resetTimer > GAME_RESET_DIFF) {
             DestroyScene();
-            break;
         }
 
-        PostGameResultMessage(R"(
-                Critical
-                success)", WHITE);
-
         break;
     }
     case GameplayState::PreGameOver:
-        DrawManager::Instance().Record(g_gameState.recordedDrawings);
-        g_gameState.resetTimer = GetTime();
+        PostGameResultMessage(R"(
+                Critical
+                failure)", RED);
+        g_gameState.resetTimer = (f32)g_gameState.time;
         g_gameState.gameplayState = GameplayState::GameOver;
         break;
     case GameplayState::PreGameWin:
-        DrawManager::Instance().Record(g_gameState.recordedDrawings);
-        g_gameState.resetTimer = GetTime();
+        PostGameResultMessage(R"(
+                Critical
+                success)", WHITE);
+        g_gameState.resetTimer = (f32)g_gameState.time;
         g_gameState.gameplayState = GameplayState::GameWin;
     }
 }
 
 static
 void UpdateMenu() {
-    if (IsKeyPressed(KEY_DOWN) || IsKeyPressed(KEY_S)) {
+    if (g_gameState.input.IsKeyPressed(KEY_DOWN) || g_gameState.input.IsKeyPressed(KEY_S)) {
         g_gameState.menu.Down();
     }
 
-    if (IsKeyPressed(KEY_UP) || IsKeyPressed(KEY_W)) {
+    if (g_gameState.input.IsKeyPressed(KEY_UP) || g_gameState.input.IsKeyPressed(KEY_W)) {
         g_gameState.menu.Up();
     }
 
-    if (IsKeyPressed(KEY_ENTER)) {
+    if (g_gameState.input.IsKeyPressed(KEY_ENTER)) {
         switch (g_gameState.menu.selectedOption) {
         case Menu::PLAY: 
+            // sprites would draw untextured until the atlas is uploaded
+            if (!g_gameState.assetsReady) {
+                break;
+            }
             InitScene();
             g_gameState.gameplayState = GameplayState::RunGame;
             break;
@@ -1031,7 +2052,48 @@ void UpdateMenu() {
     }
 }
 
+static
+u64 HashState(u64 hash) {
+    hash = HashBytes(hash, &g_gameState.gameplayState, sizeof(g_gameState.gameplayState));
+    hash = HashBytes(hash, &g_gameState.hitScore, sizeof(g_gameState.hitScore));
+
+    if (g_gameState.ball) {
+        const BallComponent *ballComp = g_gameState.ball->GetComponent<BallComponent>();
+        Vector2 ball[2] = { ballComp->GetCenter(), ballComp->GetVelocity() };
+        hash = HashBytes(hash, ball, sizeof(ball));
+    }
+
+    if (g_gameState.map) {
+        int blocksNum = g_gameState.map->GetBlocksNum();
+        hash = HashBytes(hash, &blocksNum, sizeof(blocksNum));
+    }
+
+    if (g_gameState.player) {
+        Vector2 player = g_gameState.player->GetComponent<PlayerComponent>()->GetCenter();
+        hash = HashBytes(hash, &player, sizeof(player));
+    }
+
+    u32 aliensNum = g_gameState.alienPool.GetActiveNum();
+    hash = HashBytes(hash, &aliensNum, sizeof(aliensNum));
+
+    return hash;
+}
+
 void Update(f32 dt, bool &exitRequested) {
+    PROFILE_SCOPE("Step");
+
+    // this thread only, the jobs of the step are added to it by ParallelFor
+    u64 &heapAllocations = HeapCounters::Instance().threadAllocations();
+    u64 heapAllocationsStart = heapAllocations;
+
+#if REPLAY_RECORDING
+    if (g_gameState.recorder.IsRecording()) {
+        g_gameState.recorder.RecordTick(g_gameState.input, g_gameState.assetsReady);
+    }
+#endif
+
+    g_gameState.time += dt;
+    g_gameState.prevCameraTarget = g_gameState.camera.target;
 
     if (g_gameState.gameplayState == GameplayState::RunGame || 
         g_gameState.gameplayState == GameplayState::PreGameOver ||
@@ -1046,79 +2108,259 @@ void Update(f32 dt, bool &exitRequested) {
     else {
         exitRequested = true;
     }
-    
+
+    g_gameState.input.Consume();
+    g_gameState.checksum = HashState(g_gameState.checksum);
+
+    g_gameState.stepHeapAllocations = heapAllocations - heapAllocationsStart;
+    PROFILE_COUNTER("Step allocs", g_gameState.stepHeapAllocations);
+}
+
+// input sampled by the main thread, the simulation must be idle
+void PollInput(const InputState &sampled) {
+    g_gameState.input.Take(sampled);
+    g_gameState.assetsReady = g_gameState.res.GetLoadProgress().IsDone();
+}
+
+// renderScale is the DrawView scale of the next frames, cached layers are rendered to match it
+void PrepareDraw(f32 renderScale) {
+    PROFILE_SCOPE("PrepareDraw");
+
+    g_gameState.res.ProcessLoads();
+
+    for (u32 i = 0; i < g_gameState.pendingUnloads.len; ++i) {
+        UnloadRenderTexture(g_gameState.pendingUnloads[i]);
+    }
+    g_gameState.pendingUnloads.Clear();
+
+    if (g_gameState.map) {
+        g_gameState.map->RefreshBlockLayer(renderScale);
+    }
+
+    DrawManager::Instance().Present();
+
+    DrawSnapshot &snapshot = g_gameState.drawSnapshot;
+    snapshot.gameplayState = g_gameState.gameplayState;
+    snapshot.menu = g_gameState.menu;
+    snapshot.hitScore = g_gameState.hitScore;
+    snapshot.stepHeapAllocations = g_gameState.stepHeapAllocations;
+    snapshot.camera = g_gameState.camera;
+    snapshot.prevCameraTarget = g_gameState.prevCameraTarget;
 }
 
+void Draw(f32 interpolation, DrawView view);
+
+// what the frame loop calls, a hot reload host points it at the loaded gameplay module
+struct GameplayApi {
+    void (*Update)(f32 dt, bool &exitRequested);
+    void (*PollInput)(const InputState &sampled);
+    void (*PrepareDraw)(f32 renderScale);
+    void (*Draw)(f32 interpolation, DrawView view);
+};
+
+static GameplayApi g_gameplay = { Update, PollInput, PrepareDraw, Draw };
+
+#if PIPELINED_SIMULATION
+//NOTE: runs the fixed steps of frame N + 1 while the main thread renders frame N. Both threads only meet in
+// Kick and Wait: between them the simulation owns g_gameState and the main thread only reads the presented
+// draw lists and the snapshot, after Wait PrepareDraw hands the new lists over. Gl calls stay on the main thread.
+class SimulationThread {
+public:
+    void Start();
+    void Stop();
+
+    // runs stepsNum fixed steps on the simulation thread
+    void Kick(int stepsNum);
+    // blocks until the kicked steps are done, returns true if one of them requested to exit
+    bool Wait();
+
+    ~SimulationThread() { Stop(); }
+
+private:
+    void Loop();
+
+    std::thread                 m_thread;
+    std::mutex                  m_mutex;
+    std::condition_variable     m_cv;
+    int                         m_stepsNum = 0;
+    bool                        m_busy = false;
+    bool                        m_running = false;
+    bool                        m_exitRequested = false;
+};
+
+void SimulationThread::Start() {
+    assert(!m_running);
+    m_running = true;
+    m_thread = std::thread(&SimulationThread::Loop, this);
+}
+
+void SimulationThread::Stop() {
+    if (!m_running) {
+        return;
+    }
+
+    Wait();
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_running = false;
+    }
+    m_cv.notify_all();
+    m_thread.join();
+}
+
+void SimulationThread::Kick(int stepsNum) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        assert(!m_busy && "Previous steps aren't waited for");
+        m_stepsNum = stepsNum;
+        m_exitRequested = false;
+        m_busy = true;
+    }
+    m_cv.notify_all();
+}
+
+bool SimulationThread::Wait() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_cv.wait(lock, [this]() { return !m_busy; });
+
+    return m_exitRequested;
+}
+
+void SimulationThread::Loop() {
+    while (true) {
+        int stepsNum = 0;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_cv.wait(lock, [this]() { return m_busy || !m_running; });
+            if (!m_running) {
+                break;
+            }
+            stepsNum = m_stepsNum;
+        }
+
+        bool exitRequested = false;
+        for (int i = 0; i < stepsNum && !exitRequested; ++i) {
+            g_gameplay.Update(TIME_STEP, exitRequested);
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_exitRequested = exitRequested;
+            m_busy = false;
+        }
+        m_cv.notify_all();
+    }
+}
+#endif
+
 static
-void DrawGame() {
+Camera2D GetScreenCamera(DrawView view) {
+    Camera2D camera = {};
+    camera.offset = view.origin;
+    camera.zoom = view.scale;
 
-    int background = g_gameState.res.Acquire("assets/bg.png");
-    DrawTextureEx(g_gameState.res.textures[background], Vector2{ 0, 0 }, 0.0f, 1.0f, WHITE);
+    return camera;
+}
 
-    BeginMode2D(g_gameState.camera);
+static
+Camera2D GetWorldCamera(DrawView view, f32 interpolation) {
+    const DrawSnapshot &snapshot = g_gameState.drawSnapshot;
+    Camera2D camera = snapshot.camera;
+    camera.target = Vector2Lerp(snapshot.prevCameraTarget, snapshot.camera.target, interpolation);
+    camera.offset = Vector2Add(view.origin, Vector2Scale(camera.offset, view.scale));
+    camera.zoom *= view.scale;
+
+    return camera;
+}
 
-    switch (g_gameState.gameplayState) {
+static
+void DrawGame(f32 interpolation, DrawView view) {
+    Camera2D screenCamera = GetScreenCamera(view);
+
+    BeginMode2D(screenCamera);
+    DrawTextureEx(g_gameState.res.textures[g_gameState.resIds.background], Vector2{ 0, 0 }, 0.0f, 1.0f, WHITE);
+    EndMode2D();
+
+    BeginMode2D(GetWorldCamera(view, interpolation));
+
+    // the presented lists stay until the next PrepareDraw, a frame without a step renders the same items again
+    switch (g_gameState.drawSnapshot.gameplayState) {
     case GameplayState::PreGameOver:
     case GameplayState::PreGameWin:
-        DrawManager::Instance().Dispatch();
-        break;
     case GameplayState::RunGame:
     case GameplayState::GameOver:
     case GameplayState::GameWin:
-        DrawManager::Instance().Dispatch();
-        DrawManager::Instance().Flush();
+        DrawManager::Instance().Dispatch(interpolation);
         break;
     }
 
-#if DEVELOPER
+#if DEVELOPER && !PIPELINED_SIMULATION
+    // reads the live collision lists
     g_gameState.collisionMgr.DebugDraw();
 #endif
 
     EndMode2D();
 
+    BeginMode2D(screenCamera);
     g_gameState.hud.Draw();
+    EndMode2D();
 
 }
 
 static
-void DrawMenu() {
-    int background = g_gameState.res.Acquire("assets/menu_bg.png");
-    DrawTextureEx(g_gameState.res.textures[background], Vector2{ 0, 0 }, 0.0f, 1.0f, WHITE);
+void DrawMenu(DrawView drawView) {
+    BeginMode2D(GetScreenCamera(drawView));
 
-    int fontId = g_gameState.res.Acquire("assets/nicefont.ttf");
-    Font font = g_gameState.res.fonts[fontId];
+    DrawTextureEx(g_gameState.res.textures[g_gameState.resIds.menuBackground], Vector2{ 0, 0 }, 0.0f, 1.0f, WHITE);
 
-    
-    DrawTextEx(font,
+    const Menu &menu = g_gameState.drawSnapshot.menu;
+    Font font = g_gameState.res.fonts[g_gameState.resIds.font];
+
+    TextCache &textCache = TextCache::Instance();
+
+    textCache.Draw(font,
         "Breakout 0.1",
-        Vector2{ g_gameState.menu.title.xpos, g_gameState.menu.title.ypos }, font.baseSize,
+        Vector2{ menu.title.xpos, menu.title.ypos }, (f32)font.baseSize,
         1.0f, WHITE);
 
-    for (int i = 0; i < g_gameState.menu.GetOptionsLen(); ++i) {
+    Resources::LoadProgress progress = g_gameState.res.GetLoadProgress();
+    if (!progress.IsDone()) {
+        textCache.Draw(font,
+            TextFormat("Loading %u/%u", progress.loaded, progress.requested),
+            Vector2{ menu.title.xpos, menu.title.ypos + font.baseSize }, font.baseSize * 0.5f,
+            1.0f, GRAY);
+    }
+
+    for (int i = 0; i < menu.GetOptionsLen(); ++i) {
         Color highlightColor = WHITE;
-        if (g_gameState.menu.selectedOption == g_gameState.menu.options[i]) {
+        if (menu.selectedOption == menu.options[i]) {
             highlightColor = MAGENTA;
         }
-        View view = g_gameState.menu.stack[i];
-        DrawTextEx(font,
-            g_gameState.menu.texts[i],
-            Vector2{ view.xpos, view.ypos }, font.baseSize,
+        View view = menu.stack[i];
+        // the highlight is a tint, it doesn't change the layout
+        textCache.Draw(font,
+            menu.texts[i],
+            Vector2{ view.xpos, view.ypos }, (f32)font.baseSize,
             1.0f, highlightColor);
     }
 
+    EndMode2D();
 }
 
-void Draw() {
+void Draw(f32 interpolation, DrawView view) {
+    PROFILE_SCOPE("Draw");
 
-    if (g_gameState.gameplayState == GameplayState::RunGame || 
-        g_gameState.gameplayState == GameplayState::PreGameOver ||
-        g_gameState.gameplayState == GameplayState::PreGameWin ||
-        g_gameState.gameplayState == GameplayState::GameOver ||
-        g_gameState.gameplayState == GameplayState::GameWin) {
-         DrawGame();
+
+    GameplayState gameplayState = g_gameState.drawSnapshot.gameplayState;
+    if (gameplayState == GameplayState::RunGame || 
+        gameplayState == GameplayState::PreGameOver ||
+        gameplayState == GameplayState::PreGameWin ||
+        gameplayState == GameplayState::GameOver ||
+        gameplayState == GameplayState::GameWin) {
+         DrawGame(interpolation, view);
     }
     else {
-        DrawMenu();
+        DrawMenu(view);
     }
 }
 
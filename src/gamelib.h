@@ -2,6 +2,11 @@
 
 #include "common.h"
 #include "memory_arena.h"
+#include "job_system.h"
+#include "asset_loader.h"
+#include "profiler.h"
+#include <rlgl.h>
+#include <atomic>
 #include <iterator>
 #include <vector>
 #include <unordered_map>
@@ -18,6 +23,25 @@ void RemoveByIndex(std::vector<T> &data, int index) {
     data.pop_back();
 }
 
+template <typename T, int N>
+void RemoveByIndex(Buffer<T, N> &data, int index) {
+    assert(index >= 0 && index < (int)data.len);
+    data[index] = data[data.len - 1];
+    data.len--;
+}
+
+static constexpr u64 HASH_SEED = 0xCBF29CE484222325ull;
+
+// FNV-1a, folds size bytes into hash
+inline u64 HashBytes(u64 hash, const void *data, size_t size) {
+    const u8 *bytes = static_cast<const u8 *>(data);
+    for (size_t i = 0; i < size; ++i) {
+        hash = (hash ^ bytes[i]) * 0x100000001B3ull;
+    }
+
+    return hash;
+}
+
 using ResHandle = u32;
 
 enum ResType : int {
@@ -47,18 +71,31 @@ ResHandle ResCreateHandle(u32 index, ResType type) {
 }
 
 ResHandle INVALID_HANDLE = ResCreateHandle(0, RES_INVALID);
+//NOTE: slot 0 of every array is a placeholder, unknown names resolve to it. Request* returns
+// a handle at once, its slot holds a placeholder until ProcessLoads uploads the decoded asset. Requests and uploads
+// happen on the main thread while the simulation is idle, the arrays never grow under a reader.
 struct Resources {
-    static constexpr int MAX_RESOURCES = 32;
-
-    Buffer<Sound, MAX_RESOURCES>                    sounds;
-    Buffer<Font, MAX_RESOURCES>                     fonts;
-    Buffer<Texture2D, MAX_RESOURCES>                textures;
+    std::vector<Sound>                              sounds;
+    std::vector<Font>                               fonts;
+    std::vector<Texture2D>                          textures;
     std::unordered_map<std::string, ResHandle>      handles;
 
+    struct LoadProgress {
+        u32 requested = 0;
+        u32 loaded = 0;
+
+        bool IsDone() const { return loaded == requested; }
+    };
+
+    Resources() {
+        sounds.emplace_back();
+        fonts.emplace_back();
+        textures.emplace_back();
+    }
+
     ResHandle LoadTexture(const char *filename) {
-        Texture2D texture = ::LoadTexture(filename);
-        int index = textures.Add(texture);
-        auto handle = ResCreateHandle(index, RES_TEXTURE);
+        textures.push_back(::LoadTexture(filename));
+        auto handle = ResCreateHandle((u32)textures.size() - 1, RES_TEXTURE);
 
         handles[filename] = handle;
 
@@ -66,9 +103,8 @@ struct Resources {
     }
 
     ResHandle LoadSound(const char *filename) {
-        Sound sound = ::LoadSound(filename);
-        int index = sounds.Add(sound);
-        auto handle = ResCreateHandle(index, RES_SOUND);
+        sounds.push_back(::LoadSound(filename));
+        auto handle = ResCreateHandle((u32)sounds.size() - 1, RES_SOUND);
 
         handles[filename] = handle;
 
@@ -76,15 +112,48 @@ struct Resources {
     }
 
     ResHandle LoadFont(const char *filename, int fontSize) {
-        Font font = ::LoadFontEx(filename, fontSize, 0, 256);
-        int index = fonts.Add(font);
-        auto handle = ResCreateHandle(index, RES_FONT);
+        fonts.push_back(::LoadFontEx(filename, fontSize, 0, 256));
+        auto handle = ResCreateHandle((u32)fonts.size() - 1, RES_FONT);
+
+        handles[filename] = handle;
+
+        return handle;
+    }
 
+    // decoded on the loader threads, an empty texture until it's uploaded
+    ResHandle RequestTexture(const char *filename) {
+        textures.push_back(textures[0]);
+        u32 slot = (u32)textures.size() - 1;
+        m_loader.Request(AssetRequest{ AssetKind::Texture, slot, 0, filename });
+        m_progress.requested++;
+
+        auto handle = ResCreateHandle(slot, RES_TEXTURE);
         handles[filename] = handle;
 
         return handle;
     }
 
+    // raylib's default font stands in until it's uploaded
+    ResHandle RequestFont(const char *filename, int fontSize) {
+        fonts.push_back(GetFontDefault());
+        u32 slot = (u32)fonts.size() - 1;
+        m_loader.Request(AssetRequest{ AssetKind::Font, slot, fontSize, filename });
+        m_progress.requested++;
+
+        auto handle = ResCreateHandle(slot, RES_FONT);
+        handles[filename] = handle;
+
+        return handle;
+    }
+
+    // uploads everything decoded since the last call, main thread only
+    void ProcessLoads();
+    // blocks until every request is uploaded
+    void FinishLoads();
+    void Shutdown() { m_loader.Stop(); }
+
+    LoadProgress GetLoadProgress() const { return m_progress; }
+
     int Acquire(const std::string &name) {
         const auto handleIt = handles.find(name);
         if (handleIt != handles.end()) {
@@ -100,9 +169,110 @@ struct Resources {
         assert(type != RES_INVALID);
 
         int result = ResGetIndex(handle);
-        assert(result >= 0 && result < MAX_RESOURCES);
+        assert(result >= 0 && (type != RES_TEXTURE || result < (int)textures.size()));
+        assert(result >= 0 && (type != RES_FONT || result < (int)fonts.size()));
+        assert(result >= 0 && (type != RES_SOUND || result < (int)sounds.size()));
         return result;
     }
+
+private:
+    AssetLoader                 m_loader;
+    LoadProgress                m_progress;
+    // scratch for ProcessLoads, keeps its capacity
+    std::vector<DecodedAsset>   m_decoded;
+};
+
+void Resources::ProcessLoads() {
+    if (m_progress.IsDone()) {
+        return;
+    }
+
+    m_loader.TakeDecoded(m_decoded);
+    for (auto &asset : m_decoded) {
+        // failed assets keep their placeholder
+        if (asset.ok) {
+            switch (asset.kind) {
+            case AssetKind::Texture:
+                textures[asset.slot] = LoadTextureFromImage(asset.image);
+                break;
+            case AssetKind::Font: {
+                Font font = {};
+                font.baseSize = asset.fontSize;
+                font.glyphCount = asset.glyphsNum;
+                font.glyphPadding = asset.glyphPadding;
+                font.glyphs = asset.glyphs;
+                font.recs = asset.recs;
+                font.texture = LoadTextureFromImage(asset.image);
+                fonts[asset.slot] = font;
+
+                // owned by the font now
+                asset.glyphs = nullptr;
+                asset.recs = nullptr;
+                break;
+            }
+            }
+        }
+
+        AssetLoader::Release(asset);
+        m_progress.loaded++;
+    }
+    m_decoded.clear();
+}
+
+void Resources::FinishLoads() {
+    while (!m_progress.IsDone()) {
+        ProcessLoads();
+        std::this_thread::yield();
+    }
+}
+
+//NOTE: keyboard is sampled once per rendered frame. Presses are latched until a simulation step consumes them,
+// so frames that don't run a fixed step don't lose input. Headless runs don't poll and drive it through SetKey instead.
+struct InputState {
+    static constexpr int MAX_KEYS = 512;
+
+    bool    down[MAX_KEYS] = {};
+    bool    pressed[MAX_KEYS] = {};
+
+    void Poll() {
+        for (int key = 0; key < MAX_KEYS; ++key) {
+            down[key] = ::IsKeyDown(key);
+            pressed[key] = pressed[key] || ::IsKeyPressed(key);
+        }
+    }
+
+    void Consume() {
+        memset(pressed, 0, sizeof(pressed));
+    }
+
+    // current keys of sampled, presses add up until consumed
+    void Take(const InputState &sampled) {
+        memcpy(down, sampled.down, sizeof(down));
+        for (int key = 0; key < MAX_KEYS; ++key) {
+            pressed[key] = pressed[key] || sampled.pressed[key];
+        }
+    }
+
+    // scripted input
+    void SetKey(int key, bool isDown) {
+        assert(key >= 0 && key < MAX_KEYS);
+        pressed[key] = pressed[key] || (isDown && !down[key]);
+        down[key] = isDown;
+    }
+
+    void ReleaseAll() {
+        memset(down, 0, sizeof(down));
+    }
+
+    bool IsKeyDown(int key) const {
+        assert(key >= 0 && key < MAX_KEYS);
+        return down[key];
+    }
+
+    bool IsKeyPressed(int key) const {
+        assert(key >= 0 && key < MAX_KEYS);
+        return pressed[key];
+    }
 };
 
 struct CollisionManifold {
@@ -147,73 +317,499 @@ CollisionManifold AABBvsCircle(AABB aabb, Circle circle) {
     return result;
 }
 
-enum class DrawItemType {
-    Texture,
-    Font
+//NOTE: circle moving by delta vs a box, the ray from the circle center is tested against the box grown by the radius
+// with rounded corners. toi is the fraction of delta at first contact, normal points from the box to the circle.
+// A circle which already overlaps the box at the start hits at toi 0, depth is how far it has to move along normal
+// (the axis of least penetration, or away from the rounded corner) to stop overlapping. It's 0 for any other hit.
+bool SweptCircleVsAABB(AABB aabb, Circle circle, Vector2 delta, f32 &toi, Vector2 &normal, f32 &depth) {
+    Vector2 rel = Vector2Subtract(circle.center, aabb.center);
+    const f32 extents[2] = { aabb.halfExtents.x + circle.radius, aabb.halfExtents.y + circle.radius };
+    const f32 start[2] = { rel.x, rel.y };
+    const f32 dir[2] = { delta.x, delta.y };
+
+    f32 tEnter = -std::numeric_limits<f32>::max();
+    f32 tExit = std::numeric_limits<f32>::max();
+    Vector2 enterNormal = {};
+    depth = 0.0f;
+    for (int axis = 0; axis < 2; ++axis) {
+        if (fabsf(dir[axis]) < 1e-8f) {
+            if (start[axis] < -extents[axis] || start[axis] > extents[axis]) {
+                return false;
+            }
+            continue;
+        }
+
+        f32 t0 = (-extents[axis] - start[axis]) / dir[axis];
+        f32 t1 = (extents[axis] - start[axis]) / dir[axis];
+        f32 side = -1.0f;
+        if (t0 > t1) {
+            std::swap(t0, t1);
+            side = 1.0f;
+        }
+
+        if (t0 > tEnter) {
+            tEnter = t0;
+            enterNormal = axis == 0 ? Vector2{ side, 0.0f } : Vector2{ 0.0f, side };
+        }
+        tExit = std::min(tExit, t1);
+    }
+
+    if (tEnter > tExit || tExit < 0.0f || tEnter > 1.0f) {
+        return false;
+    }
+
+    // entering through a corner square, the rounded corner is a circle of the same radius
+    Vector2 point = Vector2Add(rel, Vector2Scale(delta, std::max(tEnter, 0.0f)));
+    if (fabsf(point.x) > aabb.halfExtents.x && fabsf(point.y) > aabb.halfExtents.y) {
+        Vector2 corner = {
+            point.x > 0.0f ? aabb.halfExtents.x : -aabb.halfExtents.x,
+            point.y > 0.0f ? aabb.halfExtents.y : -aabb.halfExtents.y
+        };
+        Vector2 m = Vector2Subtract(rel, corner);
+        f32 a = Vector2DotProduct(delta, delta);
+        f32 b = Vector2DotProduct(m, delta);
+        f32 c = Vector2DotProduct(m, m) - circle.radius * circle.radius;
+        f32 discriminant = b * b - a * c;
+        if (c <= 0.0f) {
+            // already touching the rounded corner. Centered exactly on it there's no direction from the corner,
+            // the diagonal out of the box is used instead
+            f32 distance = Vector2Length(m);
+            toi = 0.0f;
+            normal = distance > 1e-6f ? Vector2Scale(m, 1.0f / distance) : Vector2Normalize(corner);
+            depth = circle.radius - distance;
+            return true;
+        }
+
+        if (b >= 0.0f || discriminant < 0.0f) {
+            return false;
+        }
+
+        f32 t = (-b - sqrtf(discriminant)) / a;
+        if (t > 1.0f) {
+            return false;
+        }
+
+        toi = t;
+        normal = Vector2Normalize(Vector2Add(m, Vector2Scale(delta, t)));
+        return true;
+    }
+
+    if (tEnter < 0.0f) {
+        // overlapping at the start, a fast ball must not move through the box without a response
+        f32 penetrationX = extents[0] - fabsf(start[0]);
+        f32 penetrationY = extents[1] - fabsf(start[1]);
+        toi = 0.0f;
+        normal = penetrationX < penetrationY ? Vector2{ start[0] < 0.0f ? -1.0f : 1.0f, 0.0f } : Vector2{ 0.0f, start[1] < 0.0f ? -1.0f : 1.0f };
+        depth = std::min(penetrationX, penetrationY);
+        return true;
+    }
+
+    toi = tEnter;
+    normal = enterNormal;
+
+    return true;
+}
+
+//NOTE: uniform grid for static objects. Every cell keeps a small fixed list of the items overlapping it,
+// so insert/remove touch only the cells covered by the item bounds and a query only visits the cells around the area.
+// An item covering a full cell goes to the overflow list instead, which every query walks.
+template <typename T, int N>
+struct UniformGrid {
+    using Cell = Buffer<T, N>;
+
+    struct OverflowItem {
+        Rectangle   area;
+        T           item;
+    };
+
+    Rectangle                   bounds = {};
+    Vector2                     cellSize = {};
+    int                         width = 0;
+    int                         height = 0;
+    std::vector<Cell>           cells;
+    std::vector<OverflowItem>   overflow;
+
+    void Init(Rectangle gridBounds, Vector2 gridCellSize);
+    void Clear();
+    bool IsBuilt() const { return !cells.empty(); }
+
+    // area is a regular rectangle (top-left + size). False if the area is outside of the grid, the item isn't added
+    bool Insert(Rectangle area, const T &item);
+
+    template <typename Pred>
+    void Remove(Rectangle area, Pred pred);
+
+    // fn returns true to stop the query
+    template <typename Fn>
+    void Query(Rectangle area, Fn fn);
+
+private:
+    bool GetCellRange(Rectangle area, int &x0, int &y0, int &x1, int &y1) const;
 };
 
+// fixed z layers, drawn in this order
+enum class DrawLayer : u8 {
+    Background = 0,     // blocks
+    Default,
+    Foreground,         // aliens
+    Count
+};
+
+//NOTE: plain textured quad. Only the gpu id and size of the texture are kept, the dispatcher batches
+// consecutive commands with the same texture into one rlgl quad batch.
+struct TextureDrawCmd {
+    u32             texture = 0;
+    u16             textureWidth = 0;
+    u16             textureHeight = 0;
+    Rectangle       src = {};
+    Rectangle       dst = {};
+    // used only when interpolate is set, dst position is lerped from prevPosition by the render interpolation factor
+    Vector2         prevPosition = {};
+    Color           tint = WHITE;
+    DrawLayer       layer = DrawLayer::Default;
+    bool            interpolate = false;
+};
+
+static_assert(std::is_trivially_copyable<TextureDrawCmd>::value, "TextureDrawCmd must stay POD-like");
+
+inline
+TextureDrawCmd CreateTextureDrawCmd(Texture2D texture, Rectangle src, Vector2 position, Vector2 size, DrawLayer layer) {
+    TextureDrawCmd cmd = {};
+    cmd.texture = texture.id;
+    cmd.textureWidth = static_cast<u16>(texture.width);
+    cmd.textureHeight = static_cast<u16>(texture.height);
+    cmd.src = src;
+    cmd.dst = Rectangle{ position.x, position.y, size.x, size.y };
+    cmd.layer = layer;
+
+    return cmd;
+}
+
+// text item, DrawManager::Add copies the text into the frame arena
 struct DrawItem {
-    DrawItemType    type = DrawItemType::Texture;
     Vector2         position;
     Vector2         size;
-    Texture2D       texture;
-    Rectangle       src;
     Font            font;
     f32             spacing = 1.0f;
-    std::string     text;
+    const char *    text = nullptr;
     Color           color = WHITE;
-    int             z_index = 0;
 };
 
-struct RecordedDrawItems {
-    std::vector<DrawItem>    textureItems;
-    std::vector<DrawItem>    fontItems;
+//NOTE: headers of a complete set of draw lists, the items live in one frame arena buffer
+struct DrawLists {
+    ArenaArray<TextureDrawCmd>      textureItems[static_cast<int>(DrawLayer::Count)];
+    ArenaArray<DrawItem>            fontItems;
+    // frozen lists are drawn at their final positions
+    bool                            frozen = false;
+};
+
+//NOTE: commands added by one job of a parallel tick, merged into the draw lists in job order
+// so the result is the same as ticking serially. Vectors keep their capacity between steps.
+struct DeferredDrawBuffer {
+    std::vector<TextureDrawCmd>     textureItems[static_cast<int>(DrawLayer::Count)];
+
+    void Clear() {
+        for (auto &items : textureItems) {
+            items.clear();
+        }
+    }
 };
 
+//NOTE: visibility pass. Begin takes the world rectangle the camera shows during the step, submitters test their
+// bounds before building a draw cmd and skip the ones outside. Any thread can test, the counts are read after the
+// ticks and reported to the profiler. Submitters which cull a whole range at once (tiles) count it with Count.
+class Visibility {
+public:
+    // view is a regular rectangle (top-left + size), the counts start over
+    void Begin(Rectangle view);
+    Rectangle GetView() const { return m_view; }
+    bool IsVisible(Rectangle bounds);
+    // interpolated items are drawn anywhere between both positions during the frame
+    bool IsVisible(Vector2 position, Vector2 prevPosition, Vector2 size);
+    void Count(u32 visibleNum, u32 culledNum);
+    u32 GetVisibleNum() const { return m_visibleNum.load(std::memory_order_relaxed); }
+    u32 GetCulledNum() const { return m_culledNum.load(std::memory_order_relaxed); }
+
+private:
+    Rectangle           m_view = {};
+    std::atomic<u32>    m_visibleNum{ 0 };
+    std::atomic<u32>    m_culledNum{ 0 };
+};
+
+// world rectangle shown by the camera on a screen of screenSize, rotation isn't supported
+inline
+Rectangle GetCameraView(const Camera2D &camera, Vector2 screenSize) {
+    assert(camera.rotation == 0.0f && camera.zoom > 0.0f);
+
+    Rectangle view = {};
+    view.x = camera.target.x - camera.offset.x / camera.zoom;
+    view.y = camera.target.y - camera.offset.y / camera.zoom;
+    view.width = screenSize.x / camera.zoom;
+    view.height = screenSize.y / camera.zoom;
+
+    return view;
+}
+
+void Visibility::Begin(Rectangle view) {
+    m_view = view;
+    m_visibleNum.store(0, std::memory_order_relaxed);
+    m_culledNum.store(0, std::memory_order_relaxed);
+}
+
+bool Visibility::IsVisible(Rectangle bounds) {
+    bool visible = bounds.x < m_view.x + m_view.width && bounds.x + bounds.width > m_view.x &&
+        bounds.y < m_view.y + m_view.height && bounds.y + bounds.height > m_view.y;
+    (visible ? m_visibleNum : m_culledNum).fetch_add(1, std::memory_order_relaxed);
+
+    return visible;
+}
+
+bool Visibility::IsVisible(Vector2 position, Vector2 prevPosition, Vector2 size) {
+    Vector2 min = Vector2Min(position, prevPosition);
+    Vector2 max = Vector2Max(position, prevPosition);
+
+    return IsVisible(Rectangle{ min.x, min.y, max.x - min.x + size.x, max.y - min.y + size.y });
+}
+
+void Visibility::Count(u32 visibleNum, u32 culledNum) {
+    m_visibleNum.fetch_add(visibleNum, std::memory_order_relaxed);
+    m_culledNum.fetch_add(culledNum, std::memory_order_relaxed);
+}
+
 class DrawManager {
 public:
     static DrawManager &Instance();
 
+    // Add on this thread goes to buffer until EndParallelTick, null for the regular lists
+    static void SetThreadBuffer(DeferredDrawBuffer *buffer) { t_threadBuffer = buffer; }
+    // one buffer per job, valid until EndParallelTick. Buffers reserve itemsPerJob commands per layer
+    DeferredDrawBuffer *BeginParallelTick(u32 jobsNum, u32 itemsPerJob);
+    void EndParallelTick();
+
+    void SetFrameArena(FrameArena *arena);
+    void Add(const TextureDrawCmd &cmd);
     void Add(const DrawItem &item);
-    void Dispatch();
+    // draws the presented lists
+    void Dispatch(f32 interpolation = 1.0f);
+    // draws cmds right away in one batch, moved by offset and tinted. Cached quads which aren't rebuilt every step, text runs
+    void DrawQuads(const TextureDrawCmd *cmds, u32 count, Vector2 offset, Color tint);
+    // starts new lists in a fresh frame arena buffer, steps which don't flush keep adding to the last lists
     void Flush();
-    void Record(RecordedDrawItems &record);
-    void Copy(const RecordedDrawItems &record);
+    // keeps the current lists as they are, for the freeze frame at the end of a round
+    void Freeze();
+    // hands the lists built so far to Dispatch and pins their buffer. The simulation must not run at the same time,
+    // afterwards it can build the next lists while the presented ones are drawn.
+    void Present();
     DrawManager(const DrawManager &other) = delete;
     DrawManager &operator=(const DrawManager &other) = delete;
 
 private:
     DrawManager() = default;
 
-    std::vector<DrawItem>    m_textureItems;
-    std::vector<DrawItem>    m_fontItems;
+    void PushQuad(const TextureDrawCmd &cmd, f32 interpolation);
+
+    // bucketed by layer, nothing is sorted. Inside a layer items keep the submission order,
+    // components of one type tick together so same texture items are already next to each other
+    // lists live in the frame arena, Flush resets them
+    DrawLists                       m_lists;
+    // what Dispatch draws, written only by Present
+    DrawLists                       m_presented;
+    FrameArena *                    m_frameArena = nullptr;
+    std::vector<DeferredDrawBuffer> m_jobBuffers;
+    u32                             m_jobBuffersNum = 0;
+    u32                             m_batchesNum = 0;
+
+    static thread_local DeferredDrawBuffer *t_threadBuffer;
+
+public:
+    // texture batches issued by the last Dispatch
+    u32 GetBatchesNum() const { return m_batchesNum; }
+    // commands in the lists being built, what the steps since the last Flush submitted
+    u32 GetItemsNum() const;
+};
+
+//NOTE: laid out text. DrawTextEx decodes and looks every glyph up again on every call, the cache keeps the glyph quads
+// of a string per (font, string, size, spacing) and only lays it out again when one of them changes. Runs are drawn
+// through DrawManager::DrawQuads, one batch per run. The least recently used run is replaced when the cache is full.
+// Main thread only, like every other gl call.
+class TextCache {
+public:
+    static constexpr int MAX_RUNS = 64;
+    // raylib's default line spacing for '\n', the game never changes it
+    static constexpr f32 LINE_SPACING = 2.0f;
+
+    struct GlyphRun {
+        // relative to the run's origin, white
+        std::vector<TextureDrawCmd>     quads;
+        Vector2                         size = {};
+    };
+
+    static TextCache &Instance();
+
+    const GlyphRun &Get(Font font, const char *text, f32 fontSize, f32 spacing);
+    void Draw(Font font, const char *text, Vector2 position, f32 fontSize, f32 spacing, Color tint);
+    void Clear();
+
+    // layouts done since the cache was created, stays put while nothing changes
+    u64 GetLayoutsNum() const { return m_layoutsNum; }
+
+    TextCache(const TextCache &other) = delete;
+    TextCache &operator=(const TextCache &other) = delete;
+
+private:
+    struct Entry {
+        u64             hash = 0;
+        u64             lastUse = 0;
+        u32             texture = 0;
+        const void *    glyphs = nullptr;
+        f32             fontSize = 0.0f;
+        f32             spacing = 0.0f;
+        // compared on a hash match, keeps its capacity when the entry is reused
+        std::string     text;
+        GlyphRun        run;
+    };
+
+    TextCache() = default;
+
+    static void Layout(Font font, const char *text, f32 fontSize, f32 spacing, GlyphRun &run);
+
+    Entry           m_entries[MAX_RUNS];
+    u64             m_useCounter = 0;
+    u64             m_layoutsNum = 0;
 };
 
+using ComponentTypeId = u32;
+
+static constexpr int MAX_COMPONENT_TYPES = 16;
+static_assert(MAX_COMPONENT_TYPES <= 32, "GameObject keeps a u32 mask over its components");
+
 class Component {
 public:
+    // true when Tick only touches the component itself and DrawManager::Add. Such types tick in parallel,
+    // one job per TICK_JOB_SIZE pool slots, and must not create or destroy objects while ticking.
+    static constexpr bool PARALLEL_TICK = false;
+    // false for types which do nothing in Tick, they aren't walked at all
+    static constexpr bool TICKS = true;
+
     virtual void OnInit() {}
     virtual void OnDestroy() {}
     virtual void Tick(f32 dt) = 0;
     virtual void Clear() {}
     virtual const char *ComponentName() const = 0;
+    virtual ComponentTypeId TypeId() const = 0;
     virtual void OnCollision(const CollisionManifold &manifold, GameObject *collidedObject) {}
     virtual void SetOwner(GameObject *go) { m_go = go; }
     Vector2 GetPosition() const { return m_position; }
+    Vector2 GetPrevPosition() const { return m_prevPosition; }
     Vector2 GetSize() const { return m_size; }
+    u32 GetPoolSlot() const { return m_poolSlot; }
+    void SetPoolSlot(u32 slot) { m_poolSlot = slot; }
+    // inactive components stay allocated and registered but aren't ticked, see ObjectPool
+    bool IsActive() const { return m_active; }
+    void SetActive(bool active) { m_active = active; }
 protected:
     GameObject *    m_go = nullptr;
     Vector2         m_position;
+    // position at the start of the last tick, moving components keep it for render interpolation
+    Vector2         m_prevPosition;
     Vector2         m_size;
+    u32             m_poolSlot = 0;
+    bool            m_active = true;
+};
+
+//NOTE: components of one type live next to each other in fixed size chunks, so ticking a type is a linear walk
+// over the same vtable. Chunks never move, the pointers handed out to game objects stay valid until the component is freed.
+class ComponentPoolBase {
+public:
+    virtual ~ComponentPoolBase() = default;
+    virtual void Tick(f32 dt) = 0;
+    virtual void Free(Component *comp) = 0;
+    virtual void Clear() = 0;
+    virtual u32 GetCount() const = 0;
+};
+
+template <typename T>
+class ComponentPool : public ComponentPoolBase {
+public:
+    static constexpr int CHUNK_SIZE = 256;
+    // slots per job of a parallel tick, the draw buffers of the jobs are merged in slot order
+    static constexpr u32 TICK_JOB_SIZE = 32;
+
+    ComponentPool() = default;
+    ~ComponentPool() override;
+
+    ComponentPool(const ComponentPool &other) = delete;
+    ComponentPool &operator=(const ComponentPool &other) = delete;
+
+    template <typename... Args>
+    T *Allocate(Args &&...args);
+    // chunks for count more components, allocated now instead of one by one while spawning
+    void Reserve(u32 count);
+    void Tick(f32 dt) override;
+    void Free(Component *comp) override;
+    void Clear() override;
+    u32 GetCount() const override { return m_count; }
+private:
+    struct Chunk {
+        alignas(T) u8   storage[sizeof(T) * CHUNK_SIZE];
+        bool            alive[CHUNK_SIZE];
+        int             used;
+
+        T *Get(int index) { return reinterpret_cast<T *>(storage) + index; }
+    };
+
+    void AddChunk();
+
+    std::vector<Chunk *>    m_chunks;
+    // first chunk which isn't full, chunks are filled in order
+    size_t                  m_fillChunk = 0;
+    std::vector<u32>        m_freeSlots;
+    u32                     m_count = 0;
+};
+
+struct ComponentPools {
+    ComponentPoolBase *pools[MAX_COMPONENT_TYPES] = {};
+
+    ComponentPools() = default;
+    ~ComponentPools();
+
+    ComponentPools(const ComponentPools &other) = delete;
+    ComponentPools &operator=(const ComponentPools &other) = delete;
+
+    template <typename T>
+    ComponentPool<T> &Get();
+
+    // ticks every type in type id order, the components of a type in slot order
+    void Tick(f32 dt);
+    void Clear();
 };
 
+// NOTE: the type id comes from the ComponentType enum, klass must have an entry there with the same name
 #define COMPONENT_NAME(klass)                                                                                      \
+static constexpr ComponentTypeId TYPE_ID = static_cast<ComponentTypeId>(ComponentType::klass);                    \
+static_assert(TYPE_ID < MAX_COMPONENT_TYPES, "Component type id is out of range");                                 \
 const char *ComponentName() const override {                                                                       \
     return #klass;                                                                                                 \
 }                                                                                                                  \
 static const char *ClassName() {                                                                                   \
     return #klass;                                                                                                 \
+}                                                                                                                  \
+ComponentTypeId TypeId() const override {                                                                          \
+    return TYPE_ID;                                                                                                \
 }
 
+//NOTE: index of the object's slot in GameObjectManager and the generation of that slot. Objects are recycled
+// through the free list without moving, destroying one bumps the generation so old handles stop resolving.
+struct GameObjectHandle {
+    static constexpr u32 INVALID_INDEX = std::numeric_limits<u32>::max();
+
+    u32     index = INVALID_INDEX;
+    u32     generation = 0;
+
+    bool operator==(const GameObjectHandle &other) const { return index == other.index && generation == other.generation; }
+    bool operator!=(const GameObjectHandle &other) const { return !(*this == other); }
+};
+
 class GameObject {
 public:
     GameObject() = default;
@@ -227,10 +823,16 @@ public:
     GameObject &operator=(const GameObject &other) = delete;
 
     u32 GetId() const { return m_id; }
+    GameObjectHandle GetHandle() const { return m_handle; }
     GameObject *GetNext() const { return m_next; }
+    bool IsQueuedForDestroy() const { return m_queuedForDestroy; }
+    void SetQueuedForDestroy(bool queued) { m_queuedForDestroy = queued; }
     void SetId(u32 id) { m_id = id; }
+    void SetHandle(GameObjectHandle handle) { m_handle = handle; }
     void SetNext(GameObject *next) { m_next = next; }
+    void SetPools(ComponentPools *pools) { m_pools = pools; }
     void Tick(f32 dt);
+    void ReleaseComponents();
 
     template <typename T>
     void AddComponent();
@@ -242,11 +844,16 @@ public:
     T *GetComponent() const;
 private:
     u32                             m_id = 0;
-    u8 *                            m_memory = nullptr;
+    GameObjectHandle                m_handle;
     GameObject *                    m_next = nullptr;
+    bool                            m_queuedForDestroy = false;
     MemoryArena                     m_arena;
-    std::vector<Component *>        m_components;
-
+    ComponentPools *                m_pools = nullptr;
+    Buffer<Component *, MAX_COMPONENT_TYPES> m_components;
+    // bit i is set when m_components[i] is of a type which TICKS
+    u32                             m_tickedMask = 0;
+    // indexed by component type id, one component per type
+    Component *                     m_slots[MAX_COMPONENT_TYPES] = {};
 };
 
 class GameObjectManager {
@@ -257,18 +864,73 @@ public:
     void    Destroy();
     void    Tick(f32 dt);
     GameObject *Create();
+    // count objects at once, init(go, i) adds the components of the i-th one. Objects and T components
+    // are allocated up front, recycled objects are used first
+    template <typename T, typename Fn>
+    void    CreateBatch(u32 count, Fn &&init);
     void    Destroy(GameObject *go);
-    int GetIndex(GameObject *go) const;
+    // gameplay code queues objects, they are destroyed together by DestroyQueued after the simulation step
+    void    QueueDestroy(GameObject *go);
+    void    DestroyQueued();
+    // nullptr once the object was destroyed, even if its memory was recycled by Create
+    GameObject *Get(GameObjectHandle handle) const;
+    bool    IsAlive(GameObjectHandle handle) const;
+    int GetObjectsNum() const { return static_cast<int>(m_gos.size()); }
+    // fn(go) for every live object
+    template <typename Fn>
+    void ForEachObject(Fn &&fn) const {
+        for (GameObject *go : m_gos) {
+            fn(go);
+        }
+    }
+    ComponentPools &GetPools() { return m_pools; }
+    MemoryArenaStats GetMemoryStats() const { return m_arena.GetStats(); }
     GameObjectManager(const GameObjectManager &other) = delete;
     GameObjectManager &operator=(const GameObjectManager &other) = delete;
 
     ~GameObjectManager();
 private:
+    // hands out an id and appends go to the live objects
+    void    Activate(GameObject *go);
+    // allocates a new object and its slot, it isn't on the free list
+    GameObject *AllocateObject(GameObject *memory);
+
     u32                                m_genId = 0;
-    u8 *                               m_memory = nullptr;
+    static constexpr u32 NOT_ALIVE = std::numeric_limits<u32>::max();
+
     GameObject *                       m_firstFree = nullptr;
+    u32                                m_freeNum = 0;
     MemoryArena                        m_arena;
+    // live objects, densely packed
     std::vector<GameObject *>          m_gos;
+    // every object ever allocated, by handle index
+    std::vector<GameObject *>          m_slots;
+    // index into m_gos by handle index, NOT_ALIVE for objects on the free list
+    std::vector<u32>                   m_denseIndices;
+    std::vector<GameObject *>          m_destroyQueue;
+    ComponentPools                     m_pools;
+};
+
+//NOTE: prewarmed objects with a T component, for entities which come and go all the time (aliens, extra balls,
+// power ups). Prewarm creates them together with the scene and they stay alive until it's destroyed, a spawn only
+// flips the component's active flag. Anything registered by T::OnInit, collidables included, is kept while inactive.
+template <typename T>
+class ObjectPool {
+public:
+    // addComponent(go) must add the T component
+    template <typename Fn>
+    void Prewarm(GameObjectManager &goMgr, u32 count, Fn &&addComponent);
+    // nullptr when every object is in use. The component is active, the caller resets it for the new spawn
+    T *Acquire();
+    void Release(T *comp);
+    // forgets the objects, they are destroyed with the rest of the scene
+    void Clear();
+    u32 GetActiveNum() const { return static_cast<u32>(m_all.size() - m_free.size()); }
+    u32 GetCapacity() const { return static_cast<u32>(m_all.size()); }
+
+private:
+    std::vector<T *>    m_all;
+    std::vector<T *>    m_free;
 };
 
 
@@ -292,190 +954,903 @@ Rectangle UIBox2Rectangle(View box) {
     return rect;
 }
 
+template <typename T>
+ComponentPool<T>::~ComponentPool() {
+    Clear();
+    for (auto *chunk : m_chunks) {
+        free(chunk);
+    }
+    m_chunks.clear();
+}
+
+template <typename T>
+template <typename... Args>
+T *ComponentPool<T>::Allocate(Args &&...args) {
+    u32 slot = 0;
+    if (!m_freeSlots.empty()) {
+        slot = m_freeSlots.back();
+        m_freeSlots.pop_back();
+    }
+    else {
+        while (m_fillChunk < m_chunks.size() && m_chunks[m_fillChunk]->used == CHUNK_SIZE) {
+            m_fillChunk++;
+        }
+
+        if (m_fillChunk == m_chunks.size()) {
+            AddChunk();
+        }
+
+        Chunk *chunk = m_chunks[m_fillChunk];
+        slot = static_cast<u32>(m_fillChunk * CHUNK_SIZE + chunk->used);
+        chunk->used++;
+    }
+
+    Chunk *chunk = m_chunks[slot / CHUNK_SIZE];
+    int index = slot % CHUNK_SIZE;
+    T *comp = new(chunk->Get(index)) T(std::forward<Args>(args)...);
+    comp->SetPoolSlot(slot);
+    chunk->alive[index] = true;
+    m_count++;
+
+    return comp;
+}
+
+template <typename T>
+void ComponentPool<T>::Reserve(u32 count) {
+    // chunks from m_fillChunk on are only filled up to used, the ones before it are full
+    u32 capacity = static_cast<u32>(m_freeSlots.size());
+    for (size_t c = m_fillChunk; c < m_chunks.size(); ++c) {
+        capacity += CHUNK_SIZE - m_chunks[c]->used;
+    }
+
+    while (capacity < count) {
+        AddChunk();
+        capacity += CHUNK_SIZE;
+    }
+}
+
+template <typename T>
+void ComponentPool<T>::AddChunk() {
+    Chunk *chunk = (Chunk *)malloc(sizeof(Chunk));
+    memset(chunk->alive, 0, sizeof(chunk->alive));
+    chunk->used = 0;
+    m_chunks.push_back(chunk);
+}
+
+template <typename T>
+void ComponentPool<T>::Tick(f32 dt) {
+    if (!T::TICKS) {
+        return;
+    }
+
+#if JOB_SYSTEM
+    // chunks are filled in order, the used slots end in the last chunk which isn't empty
+    u32 slotsNum = 0;
+    for (size_t c = m_chunks.size(); T::PARALLEL_TICK && c > 0 && slotsNum == 0; --c) {
+        slotsNum = static_cast<u32>((c - 1) * CHUNK_SIZE + m_chunks[c - 1]->used);
+    }
+
+    if (slotsNum > TICK_JOB_SIZE && JobSystem::Instance().GetWorkersNum() > 0) {
+        u32 jobsNum = (slotsNum + TICK_JOB_SIZE - 1) / TICK_JOB_SIZE;
+        DeferredDrawBuffer *buffers = DrawManager::Instance().BeginParallelTick(jobsNum, TICK_JOB_SIZE);
+        JobSystem::Instance().ParallelFor(jobsNum, [this, buffers, slotsNum, dt](u32 job) {
+            DrawManager::SetThreadBuffer(&buffers[job]);
+            u32 end = std::min((job + 1) * TICK_JOB_SIZE, slotsNum);
+            for (u32 slot = job * TICK_JOB_SIZE; slot < end; ++slot) {
+                Chunk *chunk = m_chunks[slot / CHUNK_SIZE];
+                int i = slot % CHUNK_SIZE;
+                if (i < chunk->used && chunk->alive[i] && chunk->Get(i)->IsActive()) {
+                    chunk->Get(i)->T::Tick(dt);
+                }
+            }
+            DrawManager::SetThreadBuffer(nullptr);
+        });
+        DrawManager::Instance().EndParallelTick();
+        return;
+    }
+#endif
+
+    // chunks and used may grow while ticking (spawns), re-read them every iteration
+    for (size_t c = 0; c < m_chunks.size(); ++c) {
+        Chunk *chunk = m_chunks[c];
+        for (int i = 0; i < chunk->used; ++i) {
+            if (chunk->alive[i] && chunk->Get(i)->IsActive()) {
+                chunk->Get(i)->T::Tick(dt);
+            }
+        }
+    }
+}
+
+template <typename T>
+void ComponentPool<T>::Free(Component *comp) {
+    u32 slot = comp->GetPoolSlot();
+    Chunk *chunk = m_chunks[slot / CHUNK_SIZE];
+    int index = slot % CHUNK_SIZE;
+    assert(chunk->alive[index] && chunk->Get(index) == comp);
+
+    chunk->Get(index)->~T();
+    chunk->alive[index] = false;
+    m_freeSlots.push_back(slot);
+    m_count--;
+}
+
+template <typename T>
+void ComponentPool<T>::Clear() {
+    for (auto *chunk : m_chunks) {
+        for (int i = 0; i < chunk->used; ++i) {
+            if (chunk->alive[i]) {
+                chunk->Get(i)->~T();
+                chunk->alive[i] = false;
+            }
+        }
+        chunk->used = 0;
+    }
+
+    // the chunks are kept and refilled from the first one
+    m_fillChunk = 0;
+    m_freeSlots.clear();
+    m_count = 0;
+}
+
+template <typename T>
+ComponentPool<T> &ComponentPools::Get() {
+    ComponentPoolBase *&pool = pools[T::TYPE_ID];
+    if (pool == nullptr) {
+        pool = new ComponentPool<T>();
+    }
+
+    return *static_cast<ComponentPool<T> *>(pool);
+}
+
+void ComponentPools::Tick(f32 dt) {
+    for (auto *pool : pools) {
+        if (pool) {
+            pool->Tick(dt);
+        }
+    }
+}
+
+void ComponentPools::Clear() {
+    for (auto *pool : pools) {
+        if (pool) {
+            pool->Clear();
+        }
+    }
+}
+
+ComponentPools::~ComponentPools() {
+    for (auto *&pool : pools) {
+        delete pool;
+        pool = nullptr;
+    }
+}
+
 void GameObject::Init() {
-    const size_t capacity = 1024;
-    m_memory = (u8 *)malloc(capacity);
-    m_arena.Init(capacity, m_memory);
-    m_components.reserve(capacity);
+#if !COMPONENT_POOLS
+    const size_t chunkSize = 1024;
+    m_arena.InitGrowable(chunkSize);
+#endif
 }
 
 void GameObject::Tick(f32 dt) {
-    for (auto *comp : m_components) {
-        comp->Tick(dt);
+    for (u32 i = 0; i < m_components.len; ++i) {
+        if (m_components[i]->IsActive() && (m_tickedMask & (1u << i))) {
+            m_components[i]->Tick(dt);
+        }
     }
 }
 
 template <typename T>
 void GameObject::AddComponent() {
+    assert(m_slots[T::TYPE_ID] == nullptr);
+#if COMPONENT_POOLS
+    Component *comp = m_pools->Get<T>().Allocate();
+#else
     Component *comp = m_arena.Push<T>();
+#endif
 
     comp->OnInit();
     comp->SetOwner(this);
 
-    m_components.push_back(comp);
+    int index = m_components.Add(comp);
+    if (T::TICKS) {
+        m_tickedMask |= 1u << index;
+    }
+    m_slots[T::TYPE_ID] = comp;
 }
 
 template <typename T, typename... Args>
 void GameObject::AddComponent(Args &&...args) {
+    assert(m_slots[T::TYPE_ID] == nullptr);
+#if COMPONENT_POOLS
+    Component *comp = m_pools->Get<T>().Allocate(std::forward<Args>(args)...);
+#else
     Component *comp = m_arena.Push<T>(std::forward<Args>(args)...);
+#endif
 
     comp->SetOwner(this);
     comp->OnInit();
 
-    m_components.push_back(comp);
+    int index = m_components.Add(comp);
+    if (T::TICKS) {
+        m_tickedMask |= 1u << index;
+    }
+    m_slots[T::TYPE_ID] = comp;
 }
 
 template<typename T>
 T *GameObject::GetComponent() const {
-    for (const auto &comp : m_components) {
-        //NOTE: interned strings would be faster here
-        if (strcmp(comp->ComponentName(), T::ClassName()) == 0) {
-            return static_cast<T *>(comp);
-        }
-    }
+    Component *comp = m_slots[T::TYPE_ID];
 
-    return nullptr;
+    return static_cast<T *>(comp);
 }
 
 void GameObject::Destroy() {
-    for (auto *comp : m_components) {
-        comp->OnDestroy();
+    for (u32 i = 0; i < m_components.len; ++i) {
+        m_components[i]->OnDestroy();
     }
 
-    free(m_memory);
-
+    // the object goes back to the free list, it keeps its memory for the next Create
+    ReleaseComponents();
     Clear();
 }
 
+void GameObject::ReleaseComponents() {
+#if COMPONENT_POOLS
+    for (u32 i = 0; i < m_components.len; ++i) {
+        m_pools->pools[m_components[i]->TypeId()]->Free(m_components[i]);
+    }
+
+    m_components.Clear();
+    m_tickedMask = 0;
+    memset(m_slots, 0, sizeof(m_slots));
+#endif
+}
+
 void GameObject::Clear() {
     m_id = 0;
     m_next = nullptr;
+    m_queuedForDestroy = false;
     m_arena.Clear();
-    m_components.clear();
+    m_components.Clear();
+    m_tickedMask = 0;
+    memset(m_slots, 0, sizeof(m_slots));
 }
 
 void GameObjectManager::Init() {
-    const size_t capacity = 1024 * 1024;
-    u8 *memory = (u8 *)malloc(capacity);
-    m_arena.Init(capacity, memory);
-
-    m_gos.reserve(capacity);
+    // objects are recycled through the free list, the arena only grows with the peak object count
+    const size_t chunkSize = 256 * 1024;
+    m_arena.InitGrowable(chunkSize);
+
+    m_gos.reserve(chunkSize / sizeof(GameObject));
+    m_slots.reserve(chunkSize / sizeof(GameObject));
+    m_denseIndices.reserve(chunkSize / sizeof(GameObject));
+    m_destroyQueue.reserve(64);
 }
 
 void GameObjectManager::Destroy() {
     for (auto *go : m_gos) {
+        go->Destroy();
         go->SetNext(m_firstFree);
         m_firstFree = go;
-        go->Destroy();
+        m_freeNum++;
+
+        GameObjectHandle handle = go->GetHandle();
+        m_denseIndices[handle.index] = NOT_ALIVE;
+        handle.generation++;
+        go->SetHandle(handle);
     }
 
     m_genId = 0;
-    m_firstFree = nullptr;
     m_gos.clear();
-    m_arena.Clear();
+    m_destroyQueue.clear();
+    m_pools.Clear();
 }
 
 GameObjectManager::~GameObjectManager() {
-    free(m_memory);
+    m_arena.Free();
 }
 
 GameObject *GameObjectManager::Create() {
     GameObject *go = m_firstFree;
     if (go) {
         m_firstFree = m_firstFree->GetNext();
+        m_freeNum--;
         go->Clear();
     }
     else {
-        go = m_arena.Push<GameObject>();
-        go->Init();
+        go = AllocateObject(m_arena.Push<GameObject>());
+    }
+
+    Activate(go);
+
+    return go;
+}
+
+template <typename T, typename Fn>
+void GameObjectManager::CreateBatch(u32 count, Fn &&init) {
+    u32 recycledNum = std::min(count, m_freeNum);
+    u32 newNum = count - recycledNum;
+
+    m_gos.reserve(m_gos.size() + count);
+    m_slots.reserve(m_slots.size() + newNum);
+    m_denseIndices.reserve(m_denseIndices.size() + newNum);
+#if COMPONENT_POOLS
+    m_pools.Get<T>().Reserve(count);
+#endif
+
+    // one arena push for all the new objects
+    GameObject *newObjects = newNum > 0 ? m_arena.PushArray<GameObject>(newNum) : nullptr;
+
+    for (u32 i = 0; i < count; ++i) {
+        GameObject *go = nullptr;
+        if (i < recycledNum) {
+            go = m_firstFree;
+            m_firstFree = m_firstFree->GetNext();
+            m_freeNum--;
+            go->Clear();
+        }
+        else {
+            go = AllocateObject(newObjects + (i - recycledNum));
+        }
+
+        Activate(go);
+        init(go, i);
     }
+}
+
+template <typename T>
+template <typename Fn>
+void ObjectPool<T>::Prewarm(GameObjectManager &goMgr, u32 count, Fn &&addComponent) {
+    m_all.reserve(m_all.size() + count);
+    m_free.reserve(m_free.size() + count);
+
+    goMgr.CreateBatch<T>(count, [this, &addComponent](GameObject *go, u32) {
+        addComponent(go);
+        T *comp = go->GetComponent<T>();
+        assert(comp && "Pooled objects need a T component");
+        comp->SetActive(false);
+        m_all.push_back(comp);
+        m_free.push_back(comp);
+    });
+}
+
+template <typename T>
+T *ObjectPool<T>::Acquire() {
+    if (m_free.empty()) {
+        return nullptr;
+    }
+
+    T *comp = m_free.back();
+    m_free.pop_back();
+    comp->SetActive(true);
+
+    return comp;
+}
+
+template <typename T>
+void ObjectPool<T>::Release(T *comp) {
+    assert(comp->IsActive() && "Releasing an object which isn't in use");
+    comp->SetActive(false);
+    m_free.push_back(comp);
+}
+
+template <typename T>
+void ObjectPool<T>::Clear() {
+    m_all.clear();
+    m_free.clear();
+}
 
+GameObject *GameObjectManager::AllocateObject(GameObject *memory) {
+    GameObject *go = memory;
+    go->SetPools(&m_pools);
+    go->Init();
+
+    GameObjectHandle handle;
+    handle.index = static_cast<u32>(m_slots.size());
+    go->SetHandle(handle);
+    m_slots.push_back(go);
+    m_denseIndices.push_back(NOT_ALIVE);
+
+    return go;
+}
+
+void GameObjectManager::Activate(GameObject *go) {
     assert(m_genId + 1 < std::numeric_limits<u32>::max());
     go->SetId(m_genId++);
 
+    m_denseIndices[go->GetHandle().index] = static_cast<u32>(m_gos.size());
     m_gos.push_back(go);
-
-    return go;
 }
 
 void GameObjectManager::Tick(f32 dt) {
+    PROFILE_SCOPE("GameObjects");
+
+#if COMPONENT_POOLS
+    m_pools.Tick(dt);
+#else
     for (auto *go : m_gos) {
         go->Tick(dt);
     }
+#endif
 }
 
-int GameObjectManager::GetIndex(GameObject *go) const {
-    int idx = 0;
-    for (int i = 0; i < m_gos.size(); ++i) {
-        if (go->GetId() == m_gos[i]->GetId()) {
-            idx = i;
-            break;
-        }
-    }
+GameObject *GameObjectManager::Get(GameObjectHandle handle) const {
+    return IsAlive(handle) ? m_slots[handle.index] : nullptr;
+}
 
-    return idx;
+bool GameObjectManager::IsAlive(GameObjectHandle handle) const {
+    return handle.index < m_slots.size() &&
+        m_denseIndices[handle.index] != NOT_ALIVE &&
+        m_slots[handle.index]->GetHandle().generation == handle.generation;
 }
 
 void GameObjectManager::Destroy(GameObject *go) {
+    GameObjectHandle handle = go->GetHandle();
+    assert(IsAlive(handle) && "Destroying an object which is not alive");
+
+    // pooled components are ticked by type, they have to leave the pools together with the object
+    go->ReleaseComponents();
+
     go->SetNext(m_firstFree);
     m_firstFree = go;
+    m_freeNum++;
+
+    u32 destroyIdx = m_denseIndices[handle.index];
+    GameObject *last = m_gos.back();
+    m_denseIndices[last->GetHandle().index] = destroyIdx;
+    RemoveByIndex(m_gos, static_cast<int>(destroyIdx));
+
+    m_denseIndices[handle.index] = NOT_ALIVE;
+    handle.generation++;
+    go->SetHandle(handle);
+}
+
+void GameObjectManager::QueueDestroy(GameObject *go) {
+    // a pointer always carries the generation of its slot, only handles can tell a stale reference
+    assert(IsAlive(go->GetHandle()));
+    if (go->IsQueuedForDestroy()) {
+        return;
+    }
+
+    go->SetQueuedForDestroy(true);
+    m_destroyQueue.push_back(go);
+}
+
+void GameObjectManager::DestroyQueued() {
+    // m_gos order doesn't matter, each removal is a swap with the last live object
+    for (auto *go : m_destroyQueue) {
+        Destroy(go);
+        go->SetQueuedForDestroy(false);
+    }
+
+    m_destroyQueue.clear();
+}
+
+template <typename T, int N>
+void UniformGrid<T, N>::Init(Rectangle gridBounds, Vector2 gridCellSize) {
+    assert(gridCellSize.x > 0.0f && gridCellSize.y > 0.0f);
+
+    bounds = gridBounds;
+    cellSize = gridCellSize;
+    width = std::max(1, (int)ceilf(bounds.width / cellSize.x));
+    height = std::max(1, (int)ceilf(bounds.height / cellSize.y));
+
+    cells.clear();
+    cells.resize(width * height);
+    overflow.clear();
+}
 
-    u32 goId = go->GetId();
+template <typename T, int N>
+void UniformGrid<T, N>::Clear() {
+    bounds = {};
+    cellSize = {};
+    width = 0;
+    height = 0;
+    cells.clear();
+    overflow.clear();
+}
+
+template <typename T, int N>
+bool UniformGrid<T, N>::GetCellRange(Rectangle area, int &x0, int &y0, int &x1, int &y1) const {
+    if (!IsBuilt()) {
+        return false;
+    }
+
+    x0 = (int)floorf((area.x - bounds.x) / cellSize.x);
+    y0 = (int)floorf((area.y - bounds.y) / cellSize.y);
+    x1 = (int)floorf((area.x + area.width - bounds.x) / cellSize.x);
+    y1 = (int)floorf((area.y + area.height - bounds.y) / cellSize.y);
+
+    if (x1 < 0 || y1 < 0 || x0 >= width || y0 >= height) {
+        return false;
+    }
 
-    int destroyIdx = GetIndex(go);
+    x0 = std::max(x0, 0);
+    y0 = std::max(y0, 0);
+    x1 = std::min(x1, width - 1);
+    y1 = std::min(y1, height - 1);
 
-    RemoveByIndex(m_gos, destroyIdx);
+    return true;
 }
 
+template <typename T, int N>
+bool UniformGrid<T, N>::Insert(Rectangle area, const T &item) {
+    int x0, y0, x1, y1;
+    if (!GetCellRange(area, x0, y0, x1, y1)) {
+        return false;
+    }
+
+    // all or none of the cells, a query must not find the item in some cells and in the overflow list
+    for (int y = y0; y <= y1; ++y) {
+        for (int x = x0; x <= x1; ++x) {
+            if (cells[(y * width) + x].len >= N) {
+                overflow.push_back(OverflowItem{ area, item });
+                return true;
+            }
+        }
+    }
+
+    for (int y = y0; y <= y1; ++y) {
+        for (int x = x0; x <= x1; ++x) {
+            cells[(y * width) + x].Add(item);
+        }
+    }
+
+    return true;
+}
+
+template <typename T, int N>
+template <typename Pred>
+void UniformGrid<T, N>::Remove(Rectangle area, Pred pred) {
+    int x0, y0, x1, y1;
+    if (!GetCellRange(area, x0, y0, x1, y1)) {
+        return;
+    }
+
+    for (int y = y0; y <= y1; ++y) {
+        for (int x = x0; x <= x1; ++x) {
+            Cell &cell = cells[(y * width) + x];
+            for (int i = 0; i < (int)cell.len; ++i) {
+                if (pred(cell[i])) {
+                    RemoveByIndex(cell, i);
+                    break;
+                }
+            }
+        }
+    }
+
+    for (int i = 0; i < (int)overflow.size(); ++i) {
+        if (pred(overflow[i].item)) {
+            RemoveByIndex(overflow, i);
+            break;
+        }
+    }
+}
+
+template <typename T, int N>
+template <typename Fn>
+void UniformGrid<T, N>::Query(Rectangle area, Fn fn) {
+    int x0, y0, x1, y1;
+    if (!GetCellRange(area, x0, y0, x1, y1)) {
+        return;
+    }
+
+    for (int y = y0; y <= y1; ++y) {
+        for (int x = x0; x <= x1; ++x) {
+            const Cell &cell = cells[(y * width) + x];
+            for (int i = 0; i < (int)cell.len; ++i) {
+                if (fn(cell[i])) {
+                    return;
+                }
+            }
+        }
+    }
+
+    for (int i = 0; i < (int)overflow.size(); ++i) {
+        // only the items around the area, touching edges count like they do for the cells
+        const Rectangle &itemArea = overflow[i].area;
+        if (itemArea.x <= area.x + area.width && area.x <= itemArea.x + itemArea.width &&
+            itemArea.y <= area.y + area.height && area.y <= itemArea.y + itemArea.height) {
+            if (fn(overflow[i].item)) {
+                return;
+            }
+        }
+    }
+}
+
+thread_local DeferredDrawBuffer *DrawManager::t_threadBuffer = nullptr;
+
 DrawManager &DrawManager::Instance() {
+#if HOT_RELOAD_MODULE
+    return *HostInstance<DrawManager>::instance;
+#else
     static DrawManager instance;
 
     return instance;
+#endif
+}
+
+DeferredDrawBuffer *DrawManager::BeginParallelTick(u32 jobsNum, u32 itemsPerJob) {
+    assert(m_jobBuffersNum == 0 && "Parallel ticks can't be nested");
+    if (m_jobBuffers.size() < jobsNum) {
+        m_jobBuffers.resize(jobsNum);
+    }
+
+    for (u32 i = 0; i < jobsNum; ++i) {
+        for (auto &items : m_jobBuffers[i].textureItems) {
+            items.reserve(itemsPerJob);
+        }
+    }
+    m_jobBuffersNum = jobsNum;
+
+    return m_jobBuffers.data();
+}
+
+void DrawManager::EndParallelTick() {
+    for (u32 i = 0; i < m_jobBuffersNum; ++i) {
+        DeferredDrawBuffer &buffer = m_jobBuffers[i];
+        for (int layer = 0; layer < static_cast<int>(DrawLayer::Count); ++layer) {
+            for (const auto &cmd : buffer.textureItems[layer]) {
+                m_lists.textureItems[layer].Add(cmd);
+            }
+        }
+        buffer.Clear();
+    }
+
+    m_jobBuffersNum = 0;
+}
+
+void DrawManager::SetFrameArena(FrameArena *arena) {
+    m_frameArena = arena;
+    Flush();
+}
+
+void DrawManager::Add(const TextureDrawCmd &cmd) {
+    assert(cmd.layer < DrawLayer::Count);
+    if (t_threadBuffer) {
+        t_threadBuffer->textureItems[static_cast<int>(cmd.layer)].push_back(cmd);
+        return;
+    }
+
+    m_lists.textureItems[static_cast<int>(cmd.layer)].Add(cmd);
 }
 
 void DrawManager::Add(const DrawItem &item) {
-    switch (item.type) {
-    case DrawItemType::Texture:
-        m_textureItems.push_back(item);
-        break;
-    case DrawItemType::Font:
-        m_fontItems.push_back(item);
-        break;
+    // the frame arena belongs to the main thread
+    assert(!t_threadBuffer && "Text can't be added from a parallel tick");
+    DrawItem copy = item;
+    copy.text = m_frameArena->PushString(item.text);
+    m_lists.fontItems.Add(copy);
+}
+
+void DrawManager::PushQuad(const TextureDrawCmd &cmd, f32 interpolation) {
+    Rectangle dst = cmd.dst;
+    if (cmd.interpolate) {
+        Vector2 position = Vector2Lerp(cmd.prevPosition, Vector2{ dst.x, dst.y }, interpolation);
+        dst.x = position.x;
+        dst.y = position.y;
     }
+
+    // same layout as DrawTexturePro without rotation and origin
+    f32 invWidth = 1.0f / static_cast<f32>(cmd.textureWidth);
+    f32 invHeight = 1.0f / static_cast<f32>(cmd.textureHeight);
+    f32 u0 = cmd.src.x * invWidth;
+    f32 v0 = cmd.src.y * invHeight;
+    f32 u1 = (cmd.src.x + cmd.src.width) * invWidth;
+    f32 v1 = (cmd.src.y + cmd.src.height) * invHeight;
+
+    rlColor4ub(cmd.tint.r, cmd.tint.g, cmd.tint.b, cmd.tint.a);
+    rlNormal3f(0.0f, 0.0f, 1.0f);
+
+    rlTexCoord2f(u0, v0);
+    rlVertex2f(dst.x, dst.y);
+
+    rlTexCoord2f(u0, v1);
+    rlVertex2f(dst.x, dst.y + dst.height);
+
+    rlTexCoord2f(u1, v1);
+    rlVertex2f(dst.x + dst.width, dst.y + dst.height);
+
+    rlTexCoord2f(u1, v0);
+    rlVertex2f(dst.x + dst.width, dst.y);
 }
 
-void DrawManager::Dispatch() {
-    std::sort(m_textureItems.begin(), m_textureItems.end(), [](auto &lhs, auto &rhs) {
-        return lhs.z_index < rhs.z_index;
-    });
+void DrawManager::Dispatch(f32 interpolation) {
+    PROFILE_SCOPE("Dispatch");
+
+    m_batchesNum = 0;
 
-    for (const auto &item : m_textureItems) {
-        DrawTexturePro(item.texture,
-            item.src,
-            Rectangle{ item.position.x, item.position.y, item.size.x, item.size.y },
-            Vector2{ 0, 0 },
-            0.0f,
-            WHITE);
+    if (m_presented.frozen) {
+        interpolation = 1.0f;
     }
 
-    for (const auto &item : m_fontItems) {
-        DrawTextEx(item.font, item.text.c_str(), item.position, item.size.x, item.spacing, item.color);
+    // layers are drawn in order, a batch only ends when the texture changes. All gameplay sprites share
+    // the atlas, so they end up in one batch and only the cached block layer starts another
+    u32 batchTexture = 0;
+    for (const auto &items : m_presented.textureItems) {
+        for (size_t i = 0; i < items.size(); ++i) {
+            u32 texture = items[i].texture;
+            // texture failed to load, same as DrawTexturePro
+            if (texture == 0) {
+                continue;
+            }
+
+            if (texture != batchTexture) {
+                if (batchTexture != 0) {
+                    rlEnd();
+                }
+
+                rlSetTexture(texture);
+                rlBegin(RL_QUADS);
+                batchTexture = texture;
+                m_batchesNum++;
+            }
+
+            PushQuad(items[i], interpolation);
+        }
+    }
+
+    if (batchTexture != 0) {
+        rlEnd();
+    }
+
+    rlSetTexture(0);
+
+    for (const auto &item : m_presented.fontItems) {
+        TextCache::Instance().Draw(item.font, item.text, item.position, item.size.x, item.spacing, item.color);
     }
 }
 
 void DrawManager::Flush() {
-    m_textureItems.clear();
-    m_fontItems.clear();
+    m_frameArena->Swap();
+    for (auto &items : m_lists.textureItems) {
+        items.Reset(m_frameArena);
+    }
+    m_lists.fontItems.Reset(m_frameArena);
+    m_lists.frozen = false;
 }
 
-void DrawManager::Record(RecordedDrawItems &record) {
-    std::copy(m_textureItems.begin(), m_textureItems.end(), std::back_inserter(record.textureItems));
-    std::copy(m_fontItems.begin(), m_fontItems.end(), std::back_inserter(record.fontItems));
+void DrawManager::Freeze() {
+    m_lists.frozen = true;
+}
+
+void DrawManager::Present() {
+    // the current buffer holds the lists built so far, Flush won't clear it while they are drawn
+    m_presented = m_lists;
+    m_frameArena->Pin(m_frameArena->GetCurrentIndex());
+}
+
+u32 DrawManager::GetItemsNum() const {
+    u32 itemsNum = static_cast<u32>(m_lists.fontItems.size());
+    for (const auto &items : m_lists.textureItems) {
+        itemsNum += static_cast<u32>(items.size());
+    }
+
+    return itemsNum;
+}
+
+void DrawManager::DrawQuads(const TextureDrawCmd *cmds, u32 count, Vector2 offset, Color tint) {
+    if (count == 0 || cmds[0].texture == 0) {
+        return;
+    }
+
+    rlSetTexture(cmds[0].texture);
+    rlBegin(RL_QUADS);
+
+    for (u32 i = 0; i < count; ++i) {
+        assert(cmds[i].texture == cmds[0].texture);
+        TextureDrawCmd cmd = cmds[i];
+        cmd.dst.x += offset.x;
+        cmd.dst.y += offset.y;
+        cmd.tint = tint;
+        PushQuad(cmd, 1.0f);
+    }
+
+    rlEnd();
+    rlSetTexture(0);
 }
 
-void DrawManager::Copy(const RecordedDrawItems &record) {
-    std::copy(record.textureItems.begin(), record.textureItems.end(), std::back_inserter(m_textureItems));
-    std::copy(record.fontItems.begin(), record.fontItems.end(), std::back_inserter(m_fontItems));
+TextCache &TextCache::Instance() {
+#if HOT_RELOAD_MODULE
+    return *HostInstance<TextCache>::instance;
+#else
+    static TextCache instance;
+
+    return instance;
+#endif
+}
+
+const TextCache::GlyphRun &TextCache::Get(Font font, const char *text, f32 fontSize, f32 spacing) {
+    // same fallback as DrawTextEx, the run is laid out again once the real font is uploaded
+    if (font.texture.id == 0) {
+        font = GetFontDefault();
+    }
+
+    size_t length = strlen(text);
+    u64 hash = HashBytes(HASH_SEED, text, length);
+
+    m_useCounter++;
+
+    Entry *oldest = &m_entries[0];
+    for (Entry &entry : m_entries) {
+        if (entry.hash == hash && entry.texture == font.texture.id && entry.glyphs == font.glyphs &&
+            entry.fontSize == fontSize && entry.spacing == spacing && entry.text == text) {
+            entry.lastUse = m_useCounter;
+            return entry.run;
+        }
+        if (entry.lastUse < oldest->lastUse) {
+            oldest = &entry;
+        }
+    }
+
+    Entry &entry = *oldest;
+    entry.hash = hash;
+    entry.lastUse = m_useCounter;
+    entry.texture = font.texture.id;
+    entry.glyphs = font.glyphs;
+    entry.fontSize = fontSize;
+    entry.spacing = spacing;
+    entry.text.assign(text, length);
+    Layout(font, text, fontSize, spacing, entry.run);
+    m_layoutsNum++;
+
+    return entry.run;
+}
+
+void TextCache::Draw(Font font, const char *text, Vector2 position, f32 fontSize, f32 spacing, Color tint) {
+    const GlyphRun &run = Get(font, text, fontSize, spacing);
+    DrawManager::Instance().DrawQuads(run.quads.data(), static_cast<u32>(run.quads.size()), position, tint);
+}
+
+void TextCache::Clear() {
+    for (Entry &entry : m_entries) {
+        entry = Entry();
+    }
+    m_useCounter = 0;
+}
+
+void TextCache::Layout(Font font, const char *text, f32 fontSize, f32 spacing, GlyphRun &run) {
+    run.quads.clear();
+    run.size = {};
+
+    // same placement as DrawTextEx and DrawTextCodepoint
+    f32 scale = fontSize / static_cast<f32>(font.baseSize);
+    f32 padding = static_cast<f32>(font.glyphPadding);
+    f32 offsetX = 0.0f;
+    f32 offsetY = 0.0f;
+
+    for (int i = 0; text[i] != '\0';) {
+        int codepointSize = 0;
+        int codepoint = GetCodepointNext(&text[i], &codepointSize);
+        int index = GetGlyphIndex(font, codepoint);
+        i += codepointSize;
+
+        if (codepoint == '\n') {
+            offsetY += fontSize + LINE_SPACING;
+            offsetX = 0.0f;
+            continue;
+        }
+
+        const GlyphInfo &glyph = font.glyphs[index];
+        Rectangle rec = font.recs[index];
+
+        if (codepoint != ' ' && codepoint != '\t') {
+            TextureDrawCmd cmd = {};
+            cmd.texture = font.texture.id;
+            cmd.textureWidth = static_cast<u16>(font.texture.width);
+            cmd.textureHeight = static_cast<u16>(font.texture.height);
+            cmd.src = Rectangle{ rec.x - padding, rec.y - padding, rec.width + 2.0f * padding, rec.height + 2.0f * padding };
+            cmd.dst = Rectangle{ offsetX + (glyph.offsetX - padding) * scale, offsetY + (glyph.offsetY - padding) * scale,
+                cmd.src.width * scale, cmd.src.height * scale };
+            run.quads.push_back(cmd);
+        }
+
+        offsetX += (glyph.advanceX == 0 ? rec.width * scale : glyph.advanceX * scale) + spacing;
+        run.size.x = std::max(run.size.x, offsetX);
+    }
+
+    run.size.y = offsetY + fontSize;
 }
 
 View View::Push(f32 xpos, f32 ypos, f32 w, f32 h) {
@@ -0,0 +1,78 @@
+#include <raylib.h>
+#include "common.h"
+#include "game.h"
+#include "heap_tracking.h"
+#include "hot_reload.h"
+
+//NOTE: the gameplay module of the HotReload configuration, see hot_reload.h. It's the same code as the game's,
+// only the entry points are reached through the table BreakoutAttachModule fills.
+
+static_assert(HOT_RELOAD_MODULE, "The gameplay module is built with HOT_RELOAD_MODULE=1");
+
+namespace breakout {
+
+// the vtable pointer is the first word of the object (msvc and itanium alike). A copy constructed by this module
+// carries the module's, the object gets it without anything else being touched
+template <typename T>
+static
+void RebindVtable(T *object, const T &local) {
+    static_assert(std::is_polymorphic<T>::value, "Only polymorphic types have a vtable");
+    memcpy(static_cast<void *>(object), static_cast<const void *>(&local), sizeof(void *));
+}
+
+template <typename T>
+static
+void RebindComponents() {
+    ComponentPools &pools = g_gameState.goMgr.GetPools();
+    if (pools.pools[T::TYPE_ID]) {
+        ComponentPool<T> local;
+        RebindVtable(static_cast<ComponentPool<T> *>(pools.pools[T::TYPE_ID]), local);
+    }
+
+    g_gameState.goMgr.ForEachObject([](GameObject *go) {
+        if (T *comp = go->GetComponent<T>()) {
+            T local(*comp);
+            RebindVtable(comp, local);
+        }
+    });
+}
+
+static
+void RebindVtables() {
+    static_assert(static_cast<int>(ComponentType::Count) == 5, "New component types must be rebound too");
+
+    RebindComponents<PlayerComponent>();
+    RebindComponents<BallComponent>();
+    RebindComponents<PortalComponent>();
+    RebindComponents<AlienComponent>();
+    RebindComponents<BlockComponent>();
+}
+
+}
+
+HOT_RELOAD_EXPORT
+bool BreakoutAttachModule(const HotReloadHost *host, breakout::GameplayApi *api) {
+    if (host->apiVersion != HOT_RELOAD_API_VERSION || host->layoutHash != GetHotReloadLayoutHash()) {
+        return false;
+    }
+
+    HostInstance<breakout::GameState>::instance = host->gameState;
+    HostInstance<breakout::DrawManager>::instance = host->drawManager;
+    HostInstance<breakout::TextCache>::instance = host->textCache;
+    HostInstance<JobSystem>::instance = host->jobSystem;
+    HostInstance<HeapCounters>::instance = host->heapCounters;
+#if PROFILER
+    HostInstance<Profiler>::instance = host->profiler;
+#endif
+    // set once before Initialize, a copy is enough
+    globals::appSettings = *host->appSettings;
+
+    breakout::RebindVtables();
+
+    api->Update = breakout::Update;
+    api->PollInput = breakout::PollInput;
+    api->PrepareDraw = breakout::PrepareDraw;
+    api->Draw = breakout::Draw;
+
+    return true;
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include "common.h"
+#include "memory_arena.h"
+#include <stdlib.h>
+#include <new>
+
+//NOTE: definitions of HeapCounters and the replacement operators. Include once per binary, next to the other headers of
+// its .cpp: a second copy in the same executable doesn't link. The gameplay module has its own operators (a dll doesn't
+// use the executable's) and counts into the host's HeapCounters once it's attached.
+
+#if !HOT_RELOAD_MODULE
+static thread_local u64 t_heapAllocations = 0;
+
+static
+u64 &GetThreadHeapAllocations() {
+    return t_heapAllocations;
+}
+#endif
+
+HeapCounters &HeapCounters::Instance() {
+#if HOT_RELOAD_MODULE
+    return *HostInstance<HeapCounters>::instance;
+#else
+    // constant initialized, operator new may run before main
+    static HeapCounters counters = { &GetThreadHeapAllocations };
+
+    return counters;
+#endif
+}
+
+#if TRACK_HEAP_ALLOCATIONS
+static
+void CountHeapAllocation() {
+#if HOT_RELOAD_MODULE
+    // static initialization of the module allocates before the host handed its counters over
+    if (!HostInstance<HeapCounters>::instance) {
+        return;
+    }
+#endif
+    HeapCounters::Instance().threadAllocations()++;
+}
+
+void *operator new(size_t size) {
+    CountHeapAllocation();
+    void *result = malloc(size ? size : 1);
+    if (!result) {
+        throw std::bad_alloc();
+    }
+
+    return result;
+}
+
+void *operator new[](size_t size) {
+    return operator new(size);
+}
+
+void operator delete(void *ptr) noexcept {
+    free(ptr);
+}
+
+void operator delete[](void *ptr) noexcept {
+    free(ptr);
+}
+
+void operator delete(void *ptr, size_t) noexcept {
+    free(ptr);
+}
+
+void operator delete[](void *ptr, size_t) noexcept {
+    free(ptr);
+}
+#endif
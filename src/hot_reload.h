@@ -0,0 +1,207 @@
+#pragma once
+
+#include <raylib.h>
+#include "common.h"
+#include "game.h"
+#include <stdio.h>
+
+#if defined(_WIN32)
+// windows.h collides with raylib (CloseWindow, DrawText, Rectangle...), only the loader functions are declared
+extern "C" {
+__declspec(dllimport) void *__stdcall LoadLibraryA(const char *fileName);
+__declspec(dllimport) void *__stdcall GetProcAddress(void *module, const char *procName);
+}
+#define HOT_RELOAD_EXPORT extern "C" __declspec(dllexport)
+#else
+#include <dlfcn.h>
+#define HOT_RELOAD_EXPORT extern "C" __attribute__((visibility("default")))
+#endif
+
+//NOTE: hot reload. The HotReload configuration builds the game as usual and the gameplay a second time, as
+// BreakoutGameplay.dll (src/gameplay_module.cpp). Everything the gameplay keeps lives in the host: g_gameState with
+// its arenas and pools, DrawManager, TextCache, JobSystem, HeapCounters and Profiler. The host initializes the game with its own copy
+// of the code and then calls the frame entry points through g_gameplay, which points at the module once it's attached.
+//
+// Attaching hands the module the host's instances and rebinds the vtables of every pool and component to the
+// module's code, so existing objects run the new code from the next step on. A rebuilt module is copied and the copy
+// is loaded, the build can overwrite the original. Old modules are never unloaded: marker names, menu texts and jobs
+// may still point into them, and a session reloads a few dozen times at most.
+//
+// Only function bodies can change. A changed declaration changes the layout the host was built with, the module
+// refuses to attach (checked by size, see GetHotReloadLayoutHash) and the game has to be restarted.
+// Host and module must share the crt heap (/MD) and raylib (raylibdll.lib), the configuration is set up for it.
+
+static constexpr u32 HOT_RELOAD_API_VERSION = 1;
+static constexpr const char *HOT_RELOAD_ATTACH_FUNCTION = "BreakoutAttachModule";
+#if defined(_WIN32)
+static constexpr const char *HOT_RELOAD_MODULE_FILE = "BreakoutGameplay.dll";
+#else
+static constexpr const char *HOT_RELOAD_MODULE_FILE = "BreakoutGameplay.so";
+#endif
+
+// what the module gets from the host
+struct HotReloadHost {
+    u32                     apiVersion;
+    u64                     layoutHash;
+    breakout::GameState *   gameState;
+    const AppSettings *     appSettings;
+    breakout::DrawManager * drawManager;
+    breakout::TextCache *   textCache;
+    JobSystem *             jobSystem;
+    HeapCounters *          heapCounters;
+#if PROFILER
+    Profiler *              profiler;
+#endif
+};
+
+// fills api with the module's entry points, false if the module can't run on this host
+using HotReloadAttachFn = bool (*)(const HotReloadHost *host, breakout::GameplayApi *api);
+
+// sizes of everything host and module share. Catches added and removed members, not reordered ones
+static
+u64 GetHotReloadLayoutHash() {
+    using namespace breakout;
+
+    const u32 sizes[] = {
+        sizeof(GameState), sizeof(Map), sizeof(GameObject), sizeof(GameObjectManager), sizeof(CollisionManager),
+        sizeof(PlayerComponent), sizeof(PortalComponent), sizeof(BallComponent), sizeof(AlienComponent),
+        sizeof(BlockComponent), sizeof(DrawManager), sizeof(TextCache), sizeof(JobSystem),
+        sizeof(HeapCounters),
+#if PROFILER
+        sizeof(Profiler),
+#endif
+        static_cast<u32>(ComponentType::Count),
+    };
+
+    return HashBytes(HASH_SEED, sizes, sizeof(sizes));
+}
+
+#if !HOT_RELOAD_MODULE
+class HotReloader {
+public:
+    // seconds between two looks at the module file
+    static constexpr f64 POLL_INTERVAL = 0.25;
+    // the linker writes the module in several goes, it's loaded once it stayed the same for this long
+    static constexpr f64 SETTLE_TIME = 0.5;
+
+    // attaches the module next to the executable if it was built, otherwise the host's own gameplay keeps running.
+    // After Initialize, before the first PrepareDraw
+    void Init();
+    // main thread, the simulation must be idle: between SimulationThread::Wait and PrepareDraw
+    void Poll(f64 now);
+
+private:
+    bool Load();
+
+    char        m_path[512] = {};
+    long        m_modTime = 0;
+    int         m_size = 0;
+    // a change seen by Poll, loaded once it settled
+    long        m_pendingModTime = 0;
+    int         m_pendingSize = 0;
+    f64         m_pendingSince = 0.0;
+    f64         m_nextPoll = 0.0;
+    u32         m_loadsNum = 0;
+};
+
+void HotReloader::Init() {
+    snprintf(m_path, sizeof(m_path), "%s%s", GetApplicationDirectory(), HOT_RELOAD_MODULE_FILE);
+
+    if (!FileExists(m_path)) {
+        TraceLog(LOG_WARNING, "HOTRELOAD: %s isn't built, running the gameplay linked into the game", m_path);
+        return;
+    }
+
+    m_modTime = GetFileModTime(m_path);
+    m_size = GetFileLength(m_path);
+    Load();
+}
+
+void HotReloader::Poll(f64 now) {
+    if (now < m_nextPoll) {
+        return;
+    }
+    m_nextPoll = now + POLL_INTERVAL;
+
+    if (!FileExists(m_path)) {
+        return;
+    }
+
+    long modTime = GetFileModTime(m_path);
+    int size = GetFileLength(m_path);
+    if (modTime == m_modTime && size == m_size) {
+        m_pendingModTime = 0;
+        return;
+    }
+
+    if (modTime != m_pendingModTime || size != m_pendingSize) {
+        m_pendingModTime = modTime;
+        m_pendingSize = size;
+        m_pendingSince = now;
+        return;
+    }
+
+    if (now - m_pendingSince < SETTLE_TIME) {
+        return;
+    }
+
+    // a failed load isn't retried until the module changes again
+    m_modTime = modTime;
+    m_size = size;
+    m_pendingModTime = 0;
+    Load();
+}
+
+bool HotReloader::Load() {
+    // the loaded file stays locked, the copy is loaded so the next build can write the module
+    char livePath[sizeof(m_path) + 16];
+    snprintf(livePath, sizeof(livePath), "%s.live%u", m_path, m_loadsNum);
+
+    int dataSize = 0;
+    u8 *data = LoadFileData(m_path, &dataSize);
+    bool copied = data && SaveFileData(livePath, data, dataSize);
+    UnloadFileData(data);
+    if (!copied) {
+        TraceLog(LOG_WARNING, "HOTRELOAD: Failed to copy %s", m_path);
+        return false;
+    }
+
+#if defined(_WIN32)
+    void *module = LoadLibraryA(livePath);
+    HotReloadAttachFn attach = module ? reinterpret_cast<HotReloadAttachFn>(GetProcAddress(module, HOT_RELOAD_ATTACH_FUNCTION)) : nullptr;
+#else
+    void *module = dlopen(livePath, RTLD_NOW | RTLD_LOCAL);
+    HotReloadAttachFn attach = module ? reinterpret_cast<HotReloadAttachFn>(dlsym(module, HOT_RELOAD_ATTACH_FUNCTION)) : nullptr;
+#endif
+    if (!attach) {
+        TraceLog(LOG_WARNING, "HOTRELOAD: %s isn't a gameplay module", livePath);
+        return false;
+    }
+
+    m_loadsNum++;
+
+    HotReloadHost host = {};
+    host.apiVersion = HOT_RELOAD_API_VERSION;
+    host.layoutHash = GetHotReloadLayoutHash();
+    host.gameState = &breakout::g_gameState;
+    host.appSettings = &globals::appSettings;
+    host.drawManager = &breakout::DrawManager::Instance();
+    host.textCache = &breakout::TextCache::Instance();
+    host.jobSystem = &JobSystem::Instance();
+    host.heapCounters = &HeapCounters::Instance();
+#if PROFILER
+    host.profiler = &Profiler::Instance();
+#endif
+
+    breakout::GameplayApi api = {};
+    if (!attach(&host, &api)) {
+        TraceLog(LOG_WARNING, "HOTRELOAD: Declarations changed since the game was built, restart it to run the new module");
+        return false;
+    }
+
+    breakout::g_gameplay = api;
+    TraceLog(LOG_INFO, "HOTRELOAD: Module %u attached", m_loadsNum);
+
+    return true;
+}
+#endif
@@ -0,0 +1,233 @@
+#pragma once
+
+#include "common.h"
+#include "memory_arena.h"
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//NOTE: small work stealing job system. Every thread owns a fixed size job queue, queue 0 belongs to the thread calling ParallelFor.
+// ParallelFor spreads the indices over all queues and helps until they are done, owners pop from the back of their queue
+// and idle threads steal from the front of the others. Nothing is allocated after Init.
+
+class JobSystem {
+public:
+    static constexpr u32 MAX_JOBS_PER_QUEUE = 256;
+
+    static JobSystem &Instance();
+
+    // 0 workers runs every job on the calling thread
+    void Init(u32 workersNum);
+    void Shutdown();
+    u32 GetWorkersNum() const { return static_cast<u32>(m_workers.size()); }
+
+    // fn(index) for every index in [0, count), returns when all of them are done.
+    // Not reentrant, jobs must not call ParallelFor.
+    template <typename Fn>
+    void ParallelFor(u32 count, Fn &&fn);
+
+    JobSystem(const JobSystem &other) = delete;
+    JobSystem &operator=(const JobSystem &other) = delete;
+
+    ~JobSystem() { Shutdown(); }
+
+private:
+    using JobFn = void (*)(void *data, u32 index);
+
+    struct Job {
+        JobFn               fn;
+        void *              data;
+        u32                 index;
+        std::atomic<u32> *  pending;
+        // heap allocations of the jobs, added to the thread that waits for them
+        std::atomic<u64> *  allocations;
+    };
+
+    // ring buffer, head is the oldest job
+    struct Queue {
+        std::mutex  mutex;
+        Job         jobs[MAX_JOBS_PER_QUEUE];
+        u32         head = 0;
+        u32         count = 0;
+    };
+
+    JobSystem() = default;
+
+    bool Push(u32 queueIndex, const Job &job);
+    bool Pop(u32 queueIndex, Job &job);
+    bool Steal(u32 thiefIndex, Job &job);
+    void Run(const Job &job);
+    void WorkerLoop(u32 queueIndex);
+
+    std::vector<std::thread>    m_workers;
+    std::vector<Queue>          m_queues;
+    std::mutex                  m_wakeMutex;
+    std::condition_variable     m_wake;
+    std::atomic<u32>            m_queuedJobs{ 0 };
+    std::atomic<bool>           m_running{ false };
+};
+
+JobSystem &JobSystem::Instance() {
+#if HOT_RELOAD_MODULE
+    return *HostInstance<JobSystem>::instance;
+#else
+    static JobSystem jobSystem;
+
+    return jobSystem;
+#endif
+}
+
+void JobSystem::Init(u32 workersNum) {
+    assert(m_workers.empty() && "Job system is already running");
+
+    // mutexes can't be moved, the queues are created once with their final count
+    m_queues = std::vector<Queue>(workersNum + 1);
+    m_running = true;
+
+    m_workers.reserve(workersNum);
+    for (u32 i = 0; i < workersNum; ++i) {
+        m_workers.emplace_back(&JobSystem::WorkerLoop, this, i + 1);
+    }
+}
+
+void JobSystem::Shutdown() {
+    if (!m_running) {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_wakeMutex);
+        m_running = false;
+    }
+    m_wake.notify_all();
+
+    for (auto &worker : m_workers) {
+        worker.join();
+    }
+
+    m_workers.clear();
+    m_queues.clear();
+}
+
+template <typename Fn>
+void JobSystem::ParallelFor(u32 count, Fn &&fn) {
+    using FnType = typename std::remove_reference<Fn>::type;
+
+    if (m_workers.empty() || count <= 1) {
+        for (u32 i = 0; i < count; ++i) {
+            fn(i);
+        }
+        return;
+    }
+
+    std::atomic<u32> pending{ count };
+    std::atomic<u64> allocations{ 0 };
+    JobFn thunk = [](void *data, u32 index) {
+        (*static_cast<FnType *>(data))(index);
+    };
+
+    u32 queuesNum = static_cast<u32>(m_queues.size());
+    for (u32 i = 0; i < count; ++i) {
+        Job job = { thunk, (void *)&fn, i, &pending, &allocations };
+        if (!Push(i % queuesNum, job)) {
+            // queue is full, no point in waiting for it
+            Run(job);
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_wakeMutex);
+    }
+    m_wake.notify_all();
+
+    while (pending.load(std::memory_order_acquire) > 0) {
+        Job job;
+        if (Pop(0, job) || Steal(0, job)) {
+            Run(job);
+        }
+        else {
+            std::this_thread::yield();
+        }
+    }
+
+    HeapCounters::Instance().threadAllocations() += allocations.load(std::memory_order_relaxed);
+}
+
+bool JobSystem::Push(u32 queueIndex, const Job &job) {
+    Queue &queue = m_queues[queueIndex];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (queue.count == MAX_JOBS_PER_QUEUE) {
+        return false;
+    }
+
+    queue.jobs[(queue.head + queue.count) % MAX_JOBS_PER_QUEUE] = job;
+    queue.count++;
+    m_queuedJobs.fetch_add(1, std::memory_order_release);
+
+    return true;
+}
+
+bool JobSystem::Pop(u32 queueIndex, Job &job) {
+    Queue &queue = m_queues[queueIndex];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (queue.count == 0) {
+        return false;
+    }
+
+    queue.count--;
+    job = queue.jobs[(queue.head + queue.count) % MAX_JOBS_PER_QUEUE];
+    m_queuedJobs.fetch_sub(1, std::memory_order_relaxed);
+
+    return true;
+}
+
+bool JobSystem::Steal(u32 thiefIndex, Job &job) {
+    u32 queuesNum = static_cast<u32>(m_queues.size());
+    for (u32 offset = 1; offset < queuesNum; ++offset) {
+        Queue &queue = m_queues[(thiefIndex + offset) % queuesNum];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (queue.count == 0) {
+            continue;
+        }
+
+        job = queue.jobs[queue.head];
+        queue.head = (queue.head + 1) % MAX_JOBS_PER_QUEUE;
+        queue.count--;
+        m_queuedJobs.fetch_sub(1, std::memory_order_relaxed);
+
+        return true;
+    }
+
+    return false;
+}
+
+void JobSystem::Run(const Job &job) {
+    u64 &threadAllocations = HeapCounters::Instance().threadAllocations();
+    u64 allocationsStart = threadAllocations;
+    job.fn(job.data, job.index);
+    // moved to the job's counter, ParallelFor adds it back even when the job ran on the calling thread
+    job.allocations->fetch_add(threadAllocations - allocationsStart, std::memory_order_relaxed);
+    threadAllocations = allocationsStart;
+    job.pending->fetch_sub(1, std::memory_order_acq_rel);
+}
+
+void JobSystem::WorkerLoop(u32 queueIndex) {
+    while (true) {
+        Job job;
+        if (Pop(queueIndex, job) || Steal(queueIndex, job)) {
+            Run(job);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(m_wakeMutex);
+        m_wake.wait(lock, [this]() {
+            return !m_running || m_queuedJobs.load(std::memory_order_acquire) > 0;
+        });
+
+        if (!m_running) {
+            break;
+        }
+    }
+}
@@ -0,0 +1,315 @@
+#pragma once
+
+#include <raylib.h>
+#include "common.h"
+#include <vector>
+
+#if defined(_WIN32)
+// windows.h clashes with raylib names, only the handful of calls needed here are declared
+extern "C" {
+__declspec(dllimport) void *__stdcall CreateFileA(const char *fileName, unsigned long access, unsigned long shareMode,
+    void *security, unsigned long creation, unsigned long flags, void *templateFile);
+__declspec(dllimport) int __stdcall GetFileSizeEx(void *file, long long *size);
+__declspec(dllimport) void *__stdcall CreateFileMappingA(void *file, void *security, unsigned long protect,
+    unsigned long sizeHigh, unsigned long sizeLow, const char *name);
+__declspec(dllimport) void *__stdcall MapViewOfFile(void *mapping, unsigned long access, unsigned long offsetHigh,
+    unsigned long offsetLow, size_t size);
+__declspec(dllimport) int __stdcall UnmapViewOfFile(const void *address);
+__declspec(dllimport) int __stdcall CloseHandle(void *handle);
+}
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+//NOTE: binary level files. A fixed header is followed by the tiles, one byte per tile in Map order (row 0 is the bottom row),
+// or by (run length, tile) byte pairs for RLE levels. Everything is little endian. Files are memory mapped and Map::Load
+// reads the tiles straight from the mapping, nothing is decoded or copied up front.
+
+namespace breakout {
+
+static constexpr u32 LEVEL_FILE_MAGIC = 0x4C564C42; // "BLVL"
+static constexpr u16 LEVEL_FILE_VERSION = 1;
+static constexpr u16 LEVEL_FILE_RLE = 1 << 0;
+// bigger levels are rejected, width * height stays far from overflowing an int
+static constexpr int LEVEL_MAX_WIDTH = 1024;
+static constexpr int LEVEL_MAX_HEIGHT = 16384;
+static constexpr f32 LEVEL_MAX_TILE_SIZE = 4096.0f;
+
+#pragma pack(push, 1)
+struct LevelFileHeader {
+    u32     magic;
+    u16     version;
+    u16     flags;
+    u16     width;
+    u16     height;
+    f32     tileWidth;
+    f32     tileHeight;
+    // non empty tiles, lets the loader reserve block storage without a counting pass
+    u32     blocksNum;
+    // bytes of tile data following the header
+    u32     dataSize;
+};
+#pragma pack(pop)
+
+static_assert(sizeof(LevelFileHeader) == 28, "Level file header layout changed");
+
+// tiles of one level, they point into a mapped file or any other memory outliving Map::Load
+struct LevelData {
+    int         width = 0;
+    int         height = 0;
+    Vector2     tileSize = {};
+    int         blocksNum = 0;
+    const u8 *  tiles = nullptr;
+    u32         tilesSize = 0;
+    bool        rle = false;
+};
+
+// read only view of a whole file
+class MappedFile {
+public:
+    bool Open(const char *path);
+    void Close();
+
+    const u8 *GetData() const { return m_data; }
+    size_t GetSize() const { return m_size; }
+
+    MappedFile() = default;
+    ~MappedFile() { Close(); }
+
+    MappedFile(const MappedFile &other) = delete;
+    MappedFile &operator=(const MappedFile &other) = delete;
+
+private:
+    const u8 *  m_data = nullptr;
+    size_t      m_size = 0;
+};
+
+// calls fn(first, count, tile) for every run of equal tiles, in tile order
+template <typename Fn>
+void ForEachTileRun(const LevelData &level, Fn &&fn);
+
+// validates the header (dimensions and tile size within the limits above, block count) and the tile data against the file size
+bool ParseLevel(const u8 *data, size_t size, LevelData &level);
+// level from raw tiles, for levels built in code
+LevelData MakeLevel(const u8 *tiles, int width, int height, Vector2 tileSize);
+// header plus tile data, RLE when it's smaller
+void EncodeLevel(const LevelData &level, std::vector<u8> &out);
+
+bool MappedFile::Open(const char *path) {
+    Close();
+
+#if defined(_WIN32)
+    const unsigned long GENERIC_READ_ACCESS = 0x80000000;
+    const unsigned long SHARE_READ = 0x1;
+    const unsigned long OPEN_EXISTING_FILE = 3;
+    const unsigned long READONLY_PAGES = 0x02;
+    const unsigned long MAP_READ = 0x4;
+    void *const invalidHandle = (void *)(intptr_t)-1;
+
+    void *file = CreateFileA(path, GENERIC_READ_ACCESS, SHARE_READ, nullptr, OPEN_EXISTING_FILE, 0, nullptr);
+    if (file == invalidHandle) {
+        return false;
+    }
+
+    long long size = 0;
+    if (!GetFileSizeEx(file, &size) || size <= 0) {
+        CloseHandle(file);
+        return false;
+    }
+
+    void *mapping = CreateFileMappingA(file, nullptr, READONLY_PAGES, 0, 0, nullptr);
+    CloseHandle(file);
+    if (!mapping) {
+        return false;
+    }
+
+    // the view keeps the mapping alive
+    m_data = static_cast<const u8 *>(MapViewOfFile(mapping, MAP_READ, 0, 0, 0));
+    CloseHandle(mapping);
+    if (!m_data) {
+        return false;
+    }
+    m_size = static_cast<size_t>(size);
+#else
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size <= 0) {
+        close(fd);
+        return false;
+    }
+
+    void *data = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        return false;
+    }
+
+    m_data = static_cast<const u8 *>(data);
+    m_size = static_cast<size_t>(info.st_size);
+#endif
+
+    return true;
+}
+
+void MappedFile::Close() {
+    if (!m_data) {
+        return;
+    }
+
+#if defined(_WIN32)
+    UnmapViewOfFile(m_data);
+#else
+    munmap(const_cast<u8 *>(m_data), m_size);
+#endif
+
+    m_data = nullptr;
+    m_size = 0;
+}
+
+template <typename Fn>
+void ForEachTileRun(const LevelData &level, Fn &&fn) {
+    if (level.rle) {
+        int first = 0;
+        for (u32 i = 0; i + 1 < level.tilesSize; i += 2) {
+            int count = level.tiles[i];
+            fn(first, count, level.tiles[i + 1]);
+            first += count;
+        }
+        return;
+    }
+
+    int tilesNum = level.width * level.height;
+    int first = 0;
+    for (int i = 1; i <= tilesNum; ++i) {
+        if (i == tilesNum || level.tiles[i] != level.tiles[first]) {
+            fn(first, i - first, level.tiles[first]);
+            first = i;
+        }
+    }
+}
+
+bool ParseLevel(const u8 *data, size_t size, LevelData &level) {
+    if (size < sizeof(LevelFileHeader)) {
+        return false;
+    }
+
+    LevelFileHeader header;
+    memcpy(&header, data, sizeof(header));
+    if (header.magic != LEVEL_FILE_MAGIC || header.version != LEVEL_FILE_VERSION) {
+        return false;
+    }
+
+    if (header.width == 0 || header.height == 0 || header.width > LEVEL_MAX_WIDTH || header.height > LEVEL_MAX_HEIGHT ||
+        header.dataSize > size - sizeof(LevelFileHeader)) {
+        return false;
+    }
+
+    // written this way NaN fails too
+    if (!(header.tileWidth > 0.0f && header.tileWidth <= LEVEL_MAX_TILE_SIZE) ||
+        !(header.tileHeight > 0.0f && header.tileHeight <= LEVEL_MAX_TILE_SIZE)) {
+        return false;
+    }
+
+    level.width = header.width;
+    level.height = header.height;
+    level.tileSize = Vector2{ header.tileWidth, header.tileHeight };
+    level.blocksNum = static_cast<int>(header.blocksNum);
+    level.tiles = data + sizeof(LevelFileHeader);
+    level.tilesSize = header.dataSize;
+    level.rle = (header.flags & LEVEL_FILE_RLE) != 0;
+
+    // the block count of the header must match the tiles, LevelData::blocksNum can be trusted
+    int tilesNum = level.width * level.height;
+    int blocksNum = 0;
+    if (!level.rle) {
+        if (level.tilesSize != static_cast<u32>(tilesNum)) {
+            return false;
+        }
+
+        for (int i = 0; i < tilesNum; ++i) {
+            blocksNum += level.tiles[i] != 0;
+        }
+
+        return blocksNum == level.blocksNum;
+    }
+
+    // runs must cover the level exactly, Map::Load trusts them
+    if (level.tilesSize % 2 != 0) {
+        return false;
+    }
+
+    int covered = 0;
+    for (u32 i = 0; i < level.tilesSize; i += 2) {
+        if (level.tiles[i] == 0) {
+            return false;
+        }
+        covered += level.tiles[i];
+        blocksNum += level.tiles[i + 1] != 0 ? level.tiles[i] : 0;
+    }
+
+    return covered == tilesNum && blocksNum == level.blocksNum;
+}
+
+LevelData MakeLevel(const u8 *tiles, int width, int height, Vector2 tileSize) {
+    LevelData level;
+    level.width = width;
+    level.height = height;
+    level.tileSize = tileSize;
+    level.tiles = tiles;
+    level.tilesSize = static_cast<u32>(width * height);
+
+    for (int i = 0; i < width * height; ++i) {
+        level.blocksNum += tiles[i] != 0;
+    }
+
+    return level;
+}
+
+void EncodeLevel(const LevelData &level, std::vector<u8> &out) {
+    std::vector<u8> runs;
+    ForEachTileRun(level, [&runs](int, int count, u8 tile) {
+        while (count > 0) {
+            int length = std::min(count, 255);
+            runs.push_back(static_cast<u8>(length));
+            runs.push_back(tile);
+            count -= length;
+        }
+    });
+
+    u32 tilesNum = static_cast<u32>(level.width * level.height);
+    bool rle = runs.size() < tilesNum;
+
+    LevelFileHeader header = {};
+    header.magic = LEVEL_FILE_MAGIC;
+    header.version = LEVEL_FILE_VERSION;
+    header.flags = rle ? LEVEL_FILE_RLE : 0;
+    header.width = static_cast<u16>(level.width);
+    header.height = static_cast<u16>(level.height);
+    header.tileWidth = level.tileSize.x;
+    header.tileHeight = level.tileSize.y;
+    header.blocksNum = static_cast<u32>(level.blocksNum);
+    header.dataSize = rle ? static_cast<u32>(runs.size()) : tilesNum;
+
+    out.resize(sizeof(header) + header.dataSize);
+    memcpy(out.data(), &header, sizeof(header));
+    if (rle) {
+        memcpy(out.data() + sizeof(header), runs.data(), runs.size());
+    }
+    else {
+        // the source may be RLE itself, its runs are expanded back
+        std::vector<u8> tiles(tilesNum);
+        ForEachTileRun(level, [&tiles](int first, int count, u8 tile) {
+            memset(tiles.data() + first, tile, count);
+        });
+        memcpy(out.data() + sizeof(header), tiles.data(), tilesNum);
+    }
+}
+
+}
@@ -1,11 +1,110 @@
 #include <raylib.h>
+#include <time.h>
 #include "common.h"
 #include "game.h"
+#include "frame_pacer.h"
+#include "dynamic_resolution.h"
+#include "heap_tracking.h"
+#if HOT_RELOAD
+#include "hot_reload.h"
+#endif
+
+// returns the time spent drawing, see DynamicResolution
+static
+f64 DrawFrame(const DynamicResolution &resolution, f32 interpolation, const FramePacer &pacer) {
+    f64 drawStart = pacer.Now();
+    Rectangle destination = resolution.GetDestination();
+
+    if (resolution.IsDirect()) {
+        BeginDrawing();
+        ClearBackground(BLACK);
+
+        // the window is the render target, the letterbox bars stay black
+        BeginScissorMode((int)destination.x, (int)destination.y, (int)destination.width, (int)destination.height);
+        ClearBackground(DARKGRAY);
+        breakout::g_gameplay.Draw(interpolation, breakout::DrawView{ Vector2{ destination.x, destination.y }, resolution.GetRenderScale() });
+        EndScissorMode();
+    }
+    else {
+        RenderTexture2D target = resolution.GetTarget();
+
+        BeginTextureMode(target);
+        ClearBackground(DARKGRAY);
+
+        breakout::g_gameplay.Draw(interpolation, breakout::DrawView{ Vector2{ 0, 0 }, resolution.GetRenderScale() });
+
+        EndTextureMode();
+
+        BeginDrawing();
+
+        ClearBackground(BLACK);
+
+        PROFILE_SCOPE("Blit");
+
+        DrawTexturePro(target.texture,
+            Rectangle{ 0, 0, static_cast<f32>(target.texture.width), static_cast<f32>(-target.texture.height)},
+            destination,
+            Vector2{ 0,0 },
+            0.0f, WHITE);
+    }
+
+#if PROFILER
+    // window space, stays readable whatever the resolution scale
+    if (Profiler::Instance().IsOverlayVisible()) {
+        f32 overlayBottom = Profiler::Instance().DrawOverlay(10.0f, 10.0f);
+        overlayBottom = pacer.DrawStats(10.0f, overlayBottom + 4.0f);
+        resolution.DrawStats(10.0f, overlayBottom + 4.0f);
+    }
+#endif
+
+    // a swap waiting for the vertical blank or for raylib's frame timer says nothing about the gpu load,
+    // timed including it the draw would always take the whole frame period
+    f64 drawEnd = pacer.Now();
+    EndDrawing();
+    if (!VSYNC && !pacer.WaitsInSwap()) {
+        drawEnd = pacer.Now();
+    }
+
+    return drawEnd - drawStart;
+}
+
+static
+void HandleHotkeys(const breakout::InputState &input, FramePacer &pacer) {
+    if (input.IsKeyPressed(KEY_F5)) {
+        pacer.CyclePacing();
+    }
+
+#if PROFILER
+    if (input.IsKeyPressed(KEY_F3)) {
+        Profiler::Instance().ToggleOverlay();
+    }
+    if (input.IsKeyPressed(KEY_F4)) {
+        Profiler::Instance().ExportChromeTrace("profile.json");
+    }
+#endif
+}
+
+// EndDrawing polled the events before the pacer's wait and the pacer polls them again after it. A poll drops the
+// presses of the previous one, they are collected after both
+static
+f32 SampleInput(breakout::InputState &sampled, FramePacer &pacer) {
+    sampled.Poll();
+    f32 frameTime = pacer.BeginFrame();
+    sampled.Poll();
+
+    HandleHotkeys(sampled, pacer);
+
+    return frameTime;
+}
 
 
 int main() {
 
-    SetConfigFlags(FLAG_WINDOW_RESIZABLE);
+    unsigned int configFlags = FLAG_WINDOW_RESIZABLE;
+#if VSYNC
+    configFlags |= FLAG_VSYNC_HINT;
+#endif
+    SetConfigFlags(configFlags);
 
     globals::appSettings.name = "Breakout";
 
@@ -23,7 +122,6 @@ int main() {
 
     SetWindowMinSize(640, 480);
     SetExitKey(0);
-    SetTargetFPS(120);
     DisableCursor();
 
     if (!IsWindowReady()) {
@@ -34,46 +132,148 @@ int main() {
     globals::appSettings.screenWidth = 1920;
     globals::appSettings.screenHeight = 1080;
 
-    RenderTexture2D target = LoadRenderTexture(globals::appSettings.screenWidth, globals::appSettings.screenHeight);
+    u32 seed = static_cast<u32>(time(NULL));
+    breakout::Initialize(seed);
+#if REPLAY_RECORDING
+    breakout::g_gameState.recorder.Start(seed);
+#endif
+
+    // a 240 Hz panel gets 240 frames even if the target is lower
+    int refreshRate = GetMonitorRefreshRate(GetCurrentMonitor());
+    FramePacer pacer;
+    pacer.Init(DEFAULT_FRAME_PACING, RENDER_TARGET_FPS > 0 ? std::max(RENDER_TARGET_FPS, refreshRate) : 0, refreshRate);
+    breakout::InputState sampled;
+
+    DynamicResolution resolution;
+    resolution.Init();
+    f64 drawSeconds = 0.0;
+
+#if HOT_RELOAD
+    // the state was initialized by the game's own code, from here on the frame runs the module's
+    HotReloader reloader;
+    reloader.Init();
+#endif
+
+    f32 accumulator = 0.0f;
+    // heap allocations of the main thread's part of a frame, PrepareDraw and DrawFrame. The steps count their own
+    u64 &mainAllocations = HeapCounters::Instance().threadAllocations();
+
+#if FIXED_TIMESTEP && PIPELINED_SIMULATION
+    breakout::SimulationThread simulation;
+    simulation.Start();
 
-    breakout::Initialize();
+    // the first frame renders the initial state
+    breakout::g_gameplay.PrepareDraw(resolution.GetRenderScale());
+    f32 interpolation = 0.0f;
+    f64 displayedInputTime = pacer.GetInputSampleTime();
 
     while (!WindowShouldClose()) {
 
-        bool exitRequested = false;
-        f32 dt = GetFrameTime();
-        
-        breakout::Update(dt, exitRequested);
+#if PROFILER
+        Profiler::Instance().EndFrame();
+#endif
 
-        if (exitRequested) {
+        PROFILE_SCOPE("Frame");
+
+        // sampled as late as the pacing allows, handed over while the simulation is idle
+        f32 frameTime = SampleInput(sampled, pacer);
+        breakout::g_gameplay.PollInput(sampled);
+        sampled.Consume();
+
+        accumulator += std::min(frameTime, MAX_FRAME_TIME);
+        int stepsNum = 0;
+        while (accumulator >= TIME_STEP) {
+            stepsNum++;
+            accumulator -= TIME_STEP;
+        }
+
+        simulation.Kick(stepsNum);
+
+        // lists presented by the previous PrepareDraw, with the interpolation they were built for. A new render
+        // scale only reaches the cached layers with the next PrepareDraw
+        resolution.Update(drawSeconds, pacer.GetFramePeriod());
+        u64 frameAllocationsStart = mainAllocations;
+        drawSeconds = DrawFrame(resolution, interpolation, pacer);
+        u64 frameAllocations = mainAllocations - frameAllocationsStart;
+        // this frame shows the steps kicked last frame, with the input sampled then
+        pacer.OnPresent(displayedInputTime);
+        displayedInputTime = pacer.GetInputSampleTime();
+
+        if (simulation.Wait()) {
             break;
         }
 
-        BeginTextureMode(target);
-        ClearBackground(DARKGRAY);
+#if HOT_RELOAD
+        reloader.Poll(pacer.Now());
+#endif
 
-        breakout::Draw();
+        frameAllocationsStart = mainAllocations;
+        breakout::g_gameplay.PrepareDraw(resolution.GetRenderScale());
+        frameAllocations += mainAllocations - frameAllocationsStart;
+        PROFILE_COUNTER("Frame allocs", frameAllocations);
+        interpolation = accumulator / TIME_STEP;
+    }
 
-        EndTextureMode();
+    simulation.Stop();
+#else
+    while (!WindowShouldClose()) {
 
-        BeginDrawing();
+#if PROFILER
+        Profiler::Instance().EndFrame();
+#endif
 
-        ClearBackground(BLACK);
+        PROFILE_SCOPE("Frame");
 
-        f32 resolutionScale = globals::appSettings.GetResolutionScale();
-        DrawTexturePro(target.texture,
-            Rectangle{ 0, 0, static_cast<f32>(target.texture.width), static_cast<f32>(-target.texture.height)},
-            Rectangle{ (GetScreenWidth() - (globals::appSettings.screenWidth * resolutionScale)) * 0.5f,
-                    (GetScreenHeight() - (globals::appSettings.screenHeight * resolutionScale)) * 0.5f,
-                    globals::appSettings.screenWidth * resolutionScale,
-                    globals::appSettings.screenHeight * resolutionScale },
-            Vector2{ 0,0 },
-            0.0f, WHITE);
+        bool exitRequested = false;
+
+#if HOT_RELOAD
+        // the lists drawn last frame were presented already, the next ones are built by the new module
+        reloader.Poll(pacer.Now());
+#endif
+
+        f32 frameTime = SampleInput(sampled, pacer);
+        breakout::g_gameplay.PollInput(sampled);
+        sampled.Consume();
+
+#if FIXED_TIMESTEP
+        accumulator += std::min(frameTime, MAX_FRAME_TIME);
+        while (accumulator >= TIME_STEP && !exitRequested) {
+            breakout::g_gameplay.Update(TIME_STEP, exitRequested);
+            accumulator -= TIME_STEP;
+        }
+
+        f32 interpolation = accumulator / TIME_STEP;
+#else
+        f32 dt = frameTime;
 
-        EndDrawing();
+        breakout::g_gameplay.Update(dt, exitRequested);
+
+        f32 interpolation = 1.0f;
+#endif
+
+        if (exitRequested) {
+            break;
+        }
+
+        resolution.Update(drawSeconds, pacer.GetFramePeriod());
+        u64 frameAllocationsStart = mainAllocations;
+        breakout::g_gameplay.PrepareDraw(resolution.GetRenderScale());
+
+        drawSeconds = DrawFrame(resolution, interpolation, pacer);
+        PROFILE_COUNTER("Frame allocs", mainAllocations - frameAllocationsStart);
+        pacer.OnPresent(pacer.GetInputSampleTime());
 
     }
+#endif
+
+#if REPLAY_RECORDING
+    // the simulation is stopped, everything it stepped is in the recording
+    breakout::g_gameState.recorder.Save(breakout::REPLAY_SESSION_FILE, breakout::g_gameState.checksum);
+#endif
 
+    resolution.Shutdown();
+    breakout::g_gameState.res.Shutdown();
+    JobSystem::Instance().Shutdown();
     CloseWindow();
 
     return 0;
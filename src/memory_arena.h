@@ -1,17 +1,50 @@
 #pragma once
 
 #include "common.h"
+#include <cstddef>
+#include <new>
 
 //NOTE: simple linear allocator, made to reduce the number of allocations for entities.
+// Init with external memory gives a fixed arena which asserts when full, InitGrowable chains malloc'd chunks instead.
+
+struct MemoryArenaChunk {
+    MemoryArenaChunk *  prev;
+    u8 *                base;
+    size_t              capacity;
+    size_t              used;
+};
+
+struct ArenaMarker {
+    MemoryArenaChunk *  chunk;
+    size_t              used;
+};
+
+struct MemoryArenaStats {
+    size_t  used;
+    size_t  capacity;
+    size_t  highWater;
+    u32     chunksNum;
+};
 
 struct MemoryArena {
-    size_t  capacity = 0;
-    size_t  used = 0;
-    u8 *    base = nullptr;
+    static constexpr size_t DEFAULT_ALIGNMENT = alignof(std::max_align_t);
+
+    size_t              capacity = 0;
+    size_t              used = 0;
+    u8 *                base = nullptr;
+    // current chunk, null for a fixed arena
+    MemoryArenaChunk *  chunk = nullptr;
+    // 0 for a fixed arena
+    size_t              chunkSize = 0;
+    size_t              prevChunksUsed = 0;
+    size_t              prevChunksCapacity = 0;
+    size_t              highWater = 0;
+    u32                 chunksNum = 0;
 
     inline void Init(size_t size, u8 *memory);
+    inline void InitGrowable(size_t minChunkSize);
 
-    inline void *PushSize(size_t size);
+    inline void *PushSize(size_t size, size_t alignment = DEFAULT_ALIGNMENT);
 
     template <typename T>
     inline T *Push();
@@ -25,9 +58,45 @@ struct MemoryArena {
     template <typename T>
     inline T *PushArray(size_t length);
 
+    // uninitialized, for SoA arrays
+    template <typename T>
+    inline T *PushAligned(size_t length, size_t alignment);
+
+    inline ArenaMarker GetMarker() const;
+    inline void Reset(ArenaMarker marker);
+
+    inline MemoryArenaStats GetStats() const;
+
+    // a growable arena with more than one chunk gets a single chunk sized to the high water mark
     inline void Clear();
+    // releases the chunks of a growable arena
+    inline void Free();
+
+private:
+    inline void PushChunk(size_t minSize);
+    inline void PopChunk();
 };
 
+//NOTE: restores the arena on scope exit, for scratch memory
+struct ScopedArenaMarker {
+    MemoryArena &   arena;
+    ArenaMarker     marker;
+
+    explicit ScopedArenaMarker(MemoryArena &the_arena) : arena(the_arena), marker(the_arena.GetMarker()) {}
+    ~ScopedArenaMarker() { arena.Reset(marker); }
+
+    ScopedArenaMarker(const ScopedArenaMarker &other) = delete;
+    ScopedArenaMarker &operator=(const ScopedArenaMarker &other) = delete;
+};
+
+inline
+size_t AlignmentOffset(const u8 *ptr, size_t alignment) {
+    assert(alignment != 0 && (alignment & (alignment - 1)) == 0);
+    size_t mask = alignment - 1;
+    size_t address = (size_t)ptr;
+
+    return (alignment - (address & mask)) & mask;
+}
 
 inline 
 void MemoryArena::Init(size_t the_capacity, u8 *memory) {
@@ -35,12 +104,25 @@ void MemoryArena::Init(size_t the_capacity, u8 *memory) {
     base = memory;
 }
 
+inline
+void MemoryArena::InitGrowable(size_t minChunkSize) {
+    assert(minChunkSize > 0);
+    chunkSize = minChunkSize;
+}
+
 inline 
-void *MemoryArena::PushSize(size_t size) {
+void *MemoryArena::PushSize(size_t size, size_t alignment) {
+    size_t offset = AlignmentOffset(base + used, alignment);
+    if (base == nullptr || (used + offset + size) > capacity) {
+        assert(chunkSize != 0 && "Fixed arena is full.");
+        PushChunk(size + alignment);
+        offset = AlignmentOffset(base + used, alignment);
+    }
 
-    assert((used + size) <= capacity);
-    void *result = base + used;
-    used += size;
+    assert((used + offset + size) <= capacity);
+    void *result = base + used + offset;
+    used += offset + size;
+    highWater = std::max(highWater, prevChunksUsed + used);
 
     return result;
 }
@@ -48,7 +130,7 @@ void *MemoryArena::PushSize(size_t size) {
 template<typename T>
 inline 
 T *MemoryArena::Push() {
-    void *ptr = PushSize(sizeof(T));
+    void *ptr = PushSize(sizeof(T), alignof(T));
 
     return new(ptr) T();
 }
@@ -56,7 +138,7 @@ T *MemoryArena::Push() {
 template <typename T, typename... Args>
 inline 
 T *MemoryArena::Push(Args &&... args) {
-    void *ptr = PushSize(sizeof(T));
+    void *ptr = PushSize(sizeof(T), alignof(T));
 
     return new(ptr) T(std::forward<Args>(args)...);
 }
@@ -67,7 +149,7 @@ T *MemoryArena::PushArray() {
     constexpr size_t length = N;
     static_assert(length != 0 && "Length of array should be at least 1.");
 
-    T *ptr = (T *)PushSize(length * sizeof(T));
+    T *ptr = (T *)PushSize(length * sizeof(T), alignof(T));
     for (size_t i = 0; i < length; i++) {
         new (ptr + i) T;
     }
@@ -78,7 +160,7 @@ T *MemoryArena::PushArray() {
 template<typename T>
 inline
 T *MemoryArena::PushArray(size_t length) {
-    T *ptr = (T *)PushSize(length * sizeof(T));
+    T *ptr = (T *)PushSize(length * sizeof(T), alignof(T));
     for (size_t i = 0; i < length; i++) {
         new (ptr + i) T;
     }
@@ -86,7 +168,211 @@ T *MemoryArena::PushArray(size_t length) {
     return ptr;
 }
 
+template <typename T>
+inline
+T *MemoryArena::PushAligned(size_t length, size_t alignment) {
+    static_assert(std::is_trivially_constructible<T>::value, "T must be trivially constructible");
+
+    return (T *)PushSize(length * sizeof(T), std::max(alignment, alignof(T)));
+}
+
+inline
+ArenaMarker MemoryArena::GetMarker() const {
+    return ArenaMarker{ chunk, used };
+}
+
+inline
+void MemoryArena::Reset(ArenaMarker marker) {
+    while (chunk != marker.chunk) {
+        assert(chunk && "Marker doesn't belong to this arena.");
+        PopChunk();
+    }
+
+    assert(marker.used <= used);
+    used = marker.used;
+}
+
+inline
+MemoryArenaStats MemoryArena::GetStats() const {
+    MemoryArenaStats stats;
+    stats.used = prevChunksUsed + used;
+    stats.capacity = prevChunksCapacity + capacity;
+    stats.highWater = highWater;
+    stats.chunksNum = chunksNum;
+
+    return stats;
+}
+
 inline 
 void MemoryArena::Clear() {
+    if (chunksNum > 1) {
+        Free();
+        PushChunk(highWater);
+    }
+
+    used = 0;
+}
+
+inline
+void MemoryArena::Free() {
+    if (chunkSize == 0) {
+        used = 0;
+        return;
+    }
+
+    while (chunk) {
+        PopChunk();
+    }
+
+    base = nullptr;
+    capacity = 0;
     used = 0;
-}
\ No newline at end of file
+}
+
+inline
+void MemoryArena::PushChunk(size_t minSize) {
+    size_t chunkCapacity = std::max(chunkSize, minSize);
+    MemoryArenaChunk *newChunk = (MemoryArenaChunk *)malloc(sizeof(MemoryArenaChunk) + chunkCapacity);
+    assert(newChunk);
+
+    if (chunk) {
+        chunk->used = used;
+        prevChunksUsed += used;
+        prevChunksCapacity += capacity;
+    }
+
+    newChunk->prev = chunk;
+    newChunk->base = (u8 *)(newChunk + 1);
+    newChunk->capacity = chunkCapacity;
+    newChunk->used = 0;
+
+    chunk = newChunk;
+    base = newChunk->base;
+    capacity = chunkCapacity;
+    used = 0;
+    chunksNum++;
+}
+
+inline
+void MemoryArena::PopChunk() {
+    MemoryArenaChunk *prev = chunk->prev;
+    free(chunk);
+    chunk = prev;
+    chunksNum--;
+
+    if (chunk) {
+        base = chunk->base;
+        capacity = chunk->capacity;
+        used = chunk->used;
+        prevChunksUsed -= used;
+        prevChunksCapacity -= capacity;
+    }
+    else {
+        base = nullptr;
+        capacity = 0;
+        used = 0;
+    }
+}
+
+//NOTE: arenas used in turns for transient draw list data (commands, strings). Swap moves to a buffer which is neither
+// the current one nor the pinned one and clears it, so the previous lists stay valid while the next ones are built
+// and the pinned buffer (lists being rendered) is never touched.
+struct FrameArena {
+    static constexpr int BUFFERS_NUM = 3;
+
+    MemoryArena     buffers[BUFFERS_NUM];
+    int             current = 0;
+    int             pinned = -1;
+
+    inline void Init(size_t capacityPerBuffer);
+
+    inline void Swap() {
+        int next = (current + 1) % BUFFERS_NUM;
+        if (next == pinned) {
+            next = (next + 1) % BUFFERS_NUM;
+        }
+
+        current = next;
+        buffers[current].Clear();
+    }
+
+    inline void Pin(int buffer) { pinned = buffer; }
+    inline int GetCurrentIndex() const { return current; }
+    inline MemoryArena &Get() { return buffers[current]; }
+
+    inline const char *PushString(const char *str);
+};
+
+inline
+void FrameArena::Init(size_t capacityPerBuffer) {
+    for (auto &buffer : buffers) {
+        buffer.InitGrowable(capacityPerBuffer);
+    }
+}
+
+inline
+const char *FrameArena::PushString(const char *str) {
+    size_t len = strlen(str) + 1;
+    char *result = (char *)Get().PushSize(len, 1);
+    memcpy(result, str, len);
+
+    return result;
+}
+
+//NOTE: growable array living in a FrameArena. Growing pushes a bigger block and leaves the old one until the arena is cleared,
+// Reset keeps the capacity so in steady state the first push allocates the whole block at once.
+template <typename T>
+struct ArenaArray {
+    static_assert(std::is_trivially_copyable<T>::value, "T must be trivially copyable");
+
+    FrameArena *    arena = nullptr;
+    T *             data = nullptr;
+    u32             len = 0;
+    u32             capacity = 0;
+
+    void Reset(FrameArena *frameArena) {
+        arena = frameArena;
+        data = nullptr;
+        len = 0;
+    }
+
+    void Add(const T &item) {
+        if (data == nullptr || len == capacity) {
+            Grow();
+        }
+
+        data[len++] = item;
+    }
+
+    T &operator[](u32 index) { return data[index]; }
+    const T &operator[](u32 index) const { return data[index]; }
+    u32 size() const { return len; }
+    T *begin() { return data; }
+    T *end() { return data + len; }
+    const T *begin() const { return data; }
+    const T *end() const { return data + len; }
+
+private:
+    void Grow() {
+        assert(arena);
+        const u32 minCapacity = 64;
+        u32 newCapacity = data == nullptr ? std::max(capacity, minCapacity) : capacity * 2;
+        T *newData = (T *)arena->Get().PushSize(newCapacity * sizeof(T), alignof(T));
+        if (len > 0) {
+            memcpy(newData, data, len * sizeof(T));
+        }
+
+        data = newData;
+        capacity = newCapacity;
+    }
+};
+
+//NOTE: operator new calls, counted per thread so a step measures its own work and not the loader's or the renderer's.
+// JobSystem hands the count of a job to the thread that ran the ParallelFor. Defined with the replacement operators in
+// heap_tracking.h, which every executable and the gameplay module include once, the module counts into the host's
+struct HeapCounters {
+    static HeapCounters &Instance();
+
+    // counter of the calling thread. Reached through the host's function, a thread_local of the module is another variable
+    u64 &               (*threadAllocations)();
+};
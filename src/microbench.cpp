@@ -0,0 +1,518 @@
+#include <raylib.h>
+#include <stdio.h>
+#include <chrono>
+#include <string>
+#include <vector>
+#include "common.h"
+#include "game.h"
+#include "heap_tracking.h"
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+// Micro benchmarks of the core data structures, written like Google Benchmark ones: a benchmark loops over a State,
+// the harness picks the iterations so a run takes MIN_RUN_SECONDS and keeps the median of REPETITIONS runs.
+// Results are compared with a stored baseline (bench/microbench_baseline.txt), a benchmark slower than the baseline
+// by more than REGRESSION_THRESHOLD fails the run. Baselines are per machine and none is checked in: without one
+// nothing is compared, --save on the reference machine writes it.
+//
+// usage: BreakoutMicroBench [--filter <substring>] [--baseline <file>] [--save <file>] [--no-window]
+
+namespace micro {
+
+static constexpr f64 MIN_RUN_SECONDS = 0.05;
+static constexpr int REPETITIONS = 5;
+static constexpr f64 REGRESSION_THRESHOLD = 0.2;
+static constexpr const char *DEFAULT_BASELINE_FILE = "bench/microbench_baseline.txt";
+
+#if defined(_MSC_VER)
+static volatile char g_sink;
+#endif
+
+// keeps the compiler from dropping the computation of value
+template <typename T>
+inline void DoNotOptimize(const T &value) {
+#if defined(_MSC_VER)
+    g_sink = *reinterpret_cast<const volatile char *>(&value);
+    _ReadWriteBarrier();
+#else
+    asm volatile("" : : "r,m"(value) : "memory");
+#endif
+}
+
+class State {
+public:
+    // the timer runs from begin() until the loop ends
+    struct Iterator {
+        State *     state;
+        u64         remaining;
+
+        bool operator!=(const Iterator &) {
+            if (remaining != 0) {
+                return true;
+            }
+            state->m_end = std::chrono::steady_clock::now();
+            return false;
+        }
+        void operator++() { --remaining; }
+        int operator*() const { return 0; }
+    };
+
+    explicit State(u64 iterations) : m_iterations(iterations) {}
+
+    Iterator begin() {
+        m_start = std::chrono::steady_clock::now();
+        return Iterator{ this, m_iterations };
+    }
+    Iterator end() { return Iterator{ this, 0 }; }
+
+    u64 GetIterations() const { return m_iterations; }
+    f64 GetSeconds() const { return std::chrono::duration<f64>(m_end - m_start).count(); }
+
+private:
+    u64                                     m_iterations;
+    std::chrono::steady_clock::time_point   m_start;
+    std::chrono::steady_clock::time_point   m_end;
+};
+
+using BenchmarkFn = void (*)(State &state);
+
+struct Benchmark {
+    const char *    name;
+    BenchmarkFn     fn;
+    // draws through rlgl, needs the hidden window
+    bool            needsWindow;
+};
+
+static
+std::vector<Benchmark> &GetBenchmarks() {
+    static std::vector<Benchmark> benchmarks;
+
+    return benchmarks;
+}
+
+struct Registrar {
+    Registrar(const char *name, BenchmarkFn fn, bool needsWindow) {
+        GetBenchmarks().push_back(Benchmark{ name, fn, needsWindow });
+    }
+};
+
+#define MICRO_CONCAT_INNER(a, b) a##b
+#define MICRO_CONCAT(a, b) MICRO_CONCAT_INNER(a, b)
+#define MICRO_BENCHMARK(fn) static micro::Registrar MICRO_CONCAT(registrar, __LINE__)(#fn, fn, false)
+#define MICRO_BENCHMARK_GL(fn) static micro::Registrar MICRO_CONCAT(registrar, __LINE__)(#fn, fn, true)
+
+struct BaselineEntry {
+    std::string     name;
+    f64             ns;
+};
+
+static
+f64 RunOnce(const Benchmark &benchmark, u64 iterations) {
+    State state(iterations);
+    benchmark.fn(state);
+
+    return state.GetSeconds();
+}
+
+// median nanoseconds per iteration
+static
+f64 Measure(const Benchmark &benchmark) {
+    u64 iterations = 1;
+    f64 seconds = RunOnce(benchmark, iterations);
+    while (seconds < MIN_RUN_SECONDS * 0.1 && iterations < (1ull << 40)) {
+        iterations *= 10;
+        seconds = RunOnce(benchmark, iterations);
+    }
+    iterations = std::max<u64>(1, (u64)(iterations * MIN_RUN_SECONDS / std::max(seconds, 1e-9)));
+
+    f64 samples[REPETITIONS];
+    for (int i = 0; i < REPETITIONS; ++i) {
+        samples[i] = RunOnce(benchmark, iterations) * 1e9 / (f64)iterations;
+    }
+    std::sort(samples, samples + REPETITIONS);
+
+    return samples[REPETITIONS / 2];
+}
+
+static
+std::vector<BaselineEntry> LoadBaseline(const char *path) {
+    std::vector<BaselineEntry> baseline;
+
+    FILE *file = fopen(path, "r");
+    if (!file) {
+        return baseline;
+    }
+
+    char line[256];
+    while (fgets(line, sizeof(line), file)) {
+        char name[128];
+        f64 ns = 0.0;
+        if (line[0] != '#' && sscanf(line, "%127s %lf", name, &ns) == 2) {
+            baseline.push_back(BaselineEntry{ name, ns });
+        }
+    }
+    fclose(file);
+
+    return baseline;
+}
+
+static
+const BaselineEntry *FindBaseline(const std::vector<BaselineEntry> &baseline, const char *name) {
+    for (const BaselineEntry &entry : baseline) {
+        if (entry.name == name) {
+            return &entry;
+        }
+    }
+
+    return nullptr;
+}
+
+}
+
+//NOTE: the benchmarks. Loops which have to undo their work to stay in a steady state (remove then add back,
+// push then reset) measure both halves, the pair is what the game pays too.
+
+namespace {
+
+using namespace breakout;
+using micro::DoNotOptimize;
+using micro::State;
+
+void BufferConstruct(State &state) {
+    for ([[maybe_unused]] auto _ : state) {
+        Buffer<Vector2, 64> buffer;
+        DoNotOptimize(buffer);
+    }
+}
+
+void BufferConstructLarge(State &state) {
+    for ([[maybe_unused]] auto _ : state) {
+        Buffer<TextureDrawCmd, 64> buffer;
+        DoNotOptimize(buffer);
+    }
+}
+
+void BufferAddClear(State &state) {
+    Buffer<Vector2, 64> buffer;
+    for ([[maybe_unused]] auto _ : state) {
+        buffer.Add(Vector2{ 1.0f, 2.0f });
+        buffer.Clear();
+        DoNotOptimize(buffer);
+    }
+}
+
+void BufferRemoveByIndex(State &state) {
+    Buffer<u32, 64> buffer;
+    for (u32 i = 0; i < 64; ++i) {
+        buffer.Add(i);
+    }
+
+    u32 index = 0;
+    for ([[maybe_unused]] auto _ : state) {
+        u32 value = buffer[index];
+        RemoveByIndex(buffer, index);
+        buffer.Add(value);
+        index = (index + 7) & 63;
+        DoNotOptimize(buffer);
+    }
+}
+
+void VectorRemoveByIndex(State &state) {
+    std::vector<u32> data(64);
+    for (u32 i = 0; i < 64; ++i) {
+        data[i] = i;
+    }
+
+    int index = 0;
+    for ([[maybe_unused]] auto _ : state) {
+        u32 value = data[index];
+        RemoveByIndex(data, index);
+        data.push_back(value);
+        index = (index + 7) & 63;
+        DoNotOptimize(data);
+    }
+}
+
+void MenuInitStartMenu(State &state) {
+    Menu menu;
+    View root = View::Push(0, 0, 1920, 1080);
+    for ([[maybe_unused]] auto _ : state) {
+        menu.InitStartMenu(root);
+        DoNotOptimize(menu);
+    }
+}
+
+void MemoryArenaPush(State &state) {
+    MemoryArena arena;
+    arena.InitGrowable(1024 * 1024);
+
+    u32 pushed = 0;
+    for ([[maybe_unused]] auto _ : state) {
+        Vector2 *value = arena.Push<Vector2>();
+        DoNotOptimize(value);
+        if (++pushed == 16 * 1024) {
+            arena.Clear();
+            pushed = 0;
+        }
+    }
+
+    arena.Free();
+}
+
+void FrameArenaPushString(State &state) {
+    FrameArena arena;
+    arena.Init(1024 * 1024);
+
+    u32 pushed = 0;
+    for ([[maybe_unused]] auto _ : state) {
+        const char *text = arena.PushString("Score: 12345");
+        DoNotOptimize(text);
+        if (++pushed == 16 * 1024) {
+            arena.Swap();
+            pushed = 0;
+        }
+    }
+
+    for (MemoryArena &buffer : arena.buffers) {
+        buffer.Free();
+    }
+}
+
+static
+Resources &GetBenchResources() {
+    static Resources res;
+    static bool initialized = false;
+    if (!initialized) {
+        // names like the game's, the placeholder slots are valid for every type
+        const char *names[] = { "assets/menu_bg.png", "assets/nicefont.ttf", "assets/bg.png", "assets/atlas.png" };
+        for (const char *name : names) {
+            res.handles[name] = ResCreateHandle(0, RES_TEXTURE);
+        }
+        initialized = true;
+    }
+
+    return res;
+}
+
+void ResourcesAcquireName(State &state) {
+    Resources &res = GetBenchResources();
+    for ([[maybe_unused]] auto _ : state) {
+        // what a call site passing a literal pays, the string is built for every lookup
+        int index = res.Acquire("assets/menu_bg.png");
+        DoNotOptimize(index);
+    }
+}
+
+void ResourcesAcquireHandle(State &state) {
+    Resources &res = GetBenchResources();
+    ResHandle handle = res.handles["assets/menu_bg.png"];
+    for ([[maybe_unused]] auto _ : state) {
+        int index = res.Acquire(handle);
+        DoNotOptimize(index);
+    }
+}
+
+void AABBvsCircleTest(State &state) {
+    const int count = 256;
+    std::vector<Circle> circles(count);
+    for (int i = 0; i < count; ++i) {
+        // about half of them touch the box
+        circles[i] = Circle{ Vector2{ (f32)(i % 16) * 12.0f - 96.0f, (f32)(i / 16) * 8.0f - 64.0f }, 16.0f };
+    }
+    AABB aabb = { Vector2{ 0.0f, 0.0f }, Vector2{ 64.0f, 16.0f } };
+
+    int index = 0;
+    for ([[maybe_unused]] auto _ : state) {
+        CollisionManifold manifold = AABBvsCircle(aabb, circles[index]);
+        DoNotOptimize(manifold);
+        index = (index + 1) & (count - 1);
+    }
+}
+
+static
+GameObject *GetBenchObject() {
+    static GameObject *go = nullptr;
+    if (!go) {
+        g_gameState.goMgr.Init();
+        go = g_gameState.goMgr.Create();
+        go->AddComponent<PlayerComponent>(0.0f, 0.0f, PlayerComponent::WIDTH, PlayerComponent::HEIGHT);
+    }
+
+    return go;
+}
+
+void GetComponentHit(State &state) {
+    GameObject *go = GetBenchObject();
+    for ([[maybe_unused]] auto _ : state) {
+        PlayerComponent *comp = go->GetComponent<PlayerComponent>();
+        DoNotOptimize(comp);
+    }
+}
+
+void GetComponentMiss(State &state) {
+    GameObject *go = GetBenchObject();
+    for ([[maybe_unused]] auto _ : state) {
+        BallComponent *comp = go->GetComponent<BallComponent>();
+        DoNotOptimize(comp);
+    }
+}
+
+static constexpr u32 DRAW_ITEMS_NUM = 1024;
+
+static
+TextureDrawCmd MakeBenchCmd(u32 texture, u32 i) {
+    TextureDrawCmd cmd = {};
+    cmd.texture = texture;
+    cmd.textureWidth = 1;
+    cmd.textureHeight = 1;
+    cmd.src = Rectangle{ 0, 0, 1, 1 };
+    cmd.dst = Rectangle{ (f32)(i % 32) * 8.0f, (f32)(i / 32) * 8.0f, 8.0f, 8.0f };
+    cmd.prevPosition = Vector2{ cmd.dst.x - 1.0f, cmd.dst.y };
+    cmd.interpolate = true;
+
+    return cmd;
+}
+
+void DrawManagerAdd(State &state) {
+    DrawManager &drawMgr = DrawManager::Instance();
+    drawMgr.Flush();
+
+    u32 added = 0;
+    for ([[maybe_unused]] auto _ : state) {
+        drawMgr.Add(MakeBenchCmd(1, added));
+        // a step's worth of items, then the next step's lists
+        if (++added == DRAW_ITEMS_NUM) {
+            drawMgr.Flush();
+            added = 0;
+        }
+    }
+}
+
+// one Dispatch of DRAW_ITEMS_NUM interpolated quads, rlgl flushes its batch to the gpu when it's full
+void DrawManagerDispatch(State &state) {
+    static Texture2D texture = {};
+    if (texture.id == 0) {
+        Image image = GenImageColor(1, 1, WHITE);
+        texture = LoadTextureFromImage(image);
+        UnloadImage(image);
+    }
+
+    DrawManager &drawMgr = DrawManager::Instance();
+    drawMgr.Flush();
+    for (u32 i = 0; i < DRAW_ITEMS_NUM; ++i) {
+        drawMgr.Add(MakeBenchCmd(texture.id, i));
+    }
+    drawMgr.Present();
+
+    BeginDrawing();
+    for ([[maybe_unused]] auto _ : state) {
+        drawMgr.Dispatch(0.5f);
+    }
+    EndDrawing();
+}
+
+MICRO_BENCHMARK(BufferConstruct);
+MICRO_BENCHMARK(BufferConstructLarge);
+MICRO_BENCHMARK(BufferAddClear);
+MICRO_BENCHMARK(BufferRemoveByIndex);
+MICRO_BENCHMARK(VectorRemoveByIndex);
+MICRO_BENCHMARK(MenuInitStartMenu);
+MICRO_BENCHMARK(MemoryArenaPush);
+MICRO_BENCHMARK(FrameArenaPushString);
+MICRO_BENCHMARK(ResourcesAcquireName);
+MICRO_BENCHMARK(ResourcesAcquireHandle);
+MICRO_BENCHMARK(AABBvsCircleTest);
+MICRO_BENCHMARK(GetComponentHit);
+MICRO_BENCHMARK(GetComponentMiss);
+MICRO_BENCHMARK(DrawManagerAdd);
+MICRO_BENCHMARK_GL(DrawManagerDispatch);
+
+}
+
+int main(int argc, char **argv) {
+    const char *filter = nullptr;
+    const char *baselinePath = micro::DEFAULT_BASELINE_FILE;
+    const char *savePath = nullptr;
+    bool window = true;
+
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc) {
+            filter = argv[++i];
+        }
+        else if (strcmp(argv[i], "--baseline") == 0 && i + 1 < argc) {
+            baselinePath = argv[++i];
+        }
+        else if (strcmp(argv[i], "--save") == 0 && i + 1 < argc) {
+            savePath = argv[++i];
+        }
+        else if (strcmp(argv[i], "--no-window") == 0) {
+            window = false;
+        }
+    }
+
+    SetTraceLogLevel(LOG_WARNING);
+
+    globals::appSettings.name = "BreakoutMicroBench";
+    globals::appSettings.screenWidth = 1920;
+    globals::appSettings.screenHeight = 1080;
+
+    if (window) {
+        // Dispatch needs a gl context, nothing is shown
+        SetConfigFlags(FLAG_WINDOW_HIDDEN);
+        InitWindow(256, 256, globals::appSettings.name);
+    }
+
+    breakout::g_gameState.frameArena.Init(4 * 1024 * 1024);
+    breakout::DrawManager::Instance().SetFrameArena(&breakout::g_gameState.frameArena);
+
+    std::vector<micro::BaselineEntry> baseline = micro::LoadBaseline(baselinePath);
+    if (baseline.empty()) {
+        printf("No baseline in %s, nothing is compared. Record one with --save on the reference machine\n", baselinePath);
+    }
+    std::vector<micro::BaselineEntry> results;
+    int regressionsNum = 0;
+
+    printf("%-26s %12s %12s %10s\n", "benchmark", "ns/op", "baseline", "change");
+
+    for (const micro::Benchmark &benchmark : micro::GetBenchmarks()) {
+        if ((filter && !strstr(benchmark.name, filter)) || (benchmark.needsWindow && !window)) {
+            continue;
+        }
+
+        f64 ns = micro::Measure(benchmark);
+        results.push_back(micro::BaselineEntry{ benchmark.name, ns });
+
+        const micro::BaselineEntry *entry = micro::FindBaseline(baseline, benchmark.name);
+        if (!entry || entry->ns <= 0.0) {
+            printf("%-26s %12.2f %12s %10s\n", benchmark.name, ns, "-", "-");
+            continue;
+        }
+
+        f64 change = ns / entry->ns - 1.0;
+        bool regressed = change > micro::REGRESSION_THRESHOLD;
+        regressionsNum += regressed;
+        printf("%-26s %12.2f %12.2f %+9.1f%%%s\n", benchmark.name, ns, entry->ns, change * 100.0, regressed ? " SLOWER" : "");
+    }
+
+    if (savePath) {
+        FILE *file = fopen(savePath, "w");
+        if (file) {
+            fprintf(file, "# BreakoutMicroBench baseline, nanoseconds per iteration. Regenerate with --save on the reference machine\n");
+            for (const micro::BaselineEntry &entry : results) {
+                fprintf(file, "%s %.3f\n", entry.name.c_str(), entry.ns);
+            }
+            fclose(file);
+        }
+        else {
+            fprintf(stderr, "Failed to write %s\n", savePath);
+        }
+    }
+
+    if (window) {
+        CloseWindow();
+    }
+    JobSystem::Instance().Shutdown();
+
+    return regressionsNum > 0 ? 1 : 0;
+}
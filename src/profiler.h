@@ -0,0 +1,390 @@
+#pragma once
+
+#include <raylib.h>
+#include "common.h"
+#include <atomic>
+#include <chrono>
+#include <stdio.h>
+
+//NOTE: frame profiler. PROFILE_SCOPE records the time spent in the enclosing scope into a lock-free ring buffer,
+// any thread can record. Once per frame the main thread folds the new events into per marker stats for the overlay,
+// the ring itself keeps the last events around for the Chrome trace export (chrome://tracing, ui.perfetto.dev).
+// PROFILE_COUNTER goes through the same ring, a counter shows the last value recorded during the frame.
+// With PROFILER 0 the markers expand to nothing.
+
+#if PROFILER
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+// name must be a string literal. Markers are matched by name, a reloaded gameplay module has its own copies
+#define PROFILE_SCOPE(name) ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(name)
+// same naming rule as the scopes
+#define PROFILE_COUNTER(name, value) Profiler::Instance().RecordCounter(name, value)
+
+class Profiler {
+public:
+    // power of two, a few seconds worth of frames at the current marker density
+    static constexpr u32 MAX_EVENTS = 1 << 14;
+    static constexpr int MAX_MARKERS = 32;
+    static constexpr int MAX_COUNTERS = 16;
+
+    struct MarkerStats {
+        const char *    name;
+        // summed over the calls of the last frame
+        f64             frameMs;
+        f64             averageMs;
+        f64             maxMs;
+        u32             calls;
+    };
+
+    struct CounterStats {
+        const char *    name;
+        // last value recorded, kept by frames which don't record it
+        u64             value;
+        f64             average;
+    };
+
+    static Profiler &Instance();
+
+    // nanoseconds since the profiler was created, steady_clock is QueryPerformanceCounter on Windows
+    u64 Now() const {
+        return static_cast<u64>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - m_epoch).count());
+    }
+
+    void Record(const char *name, u64 start, u64 end);
+    void RecordCounter(const char *name, u64 value);
+
+    // main thread only, folds the events recorded since the last call into the marker stats
+    void EndFrame();
+    // returns the y under the overlay, x and y if it's hidden
+    f32 DrawOverlay(f32 x, f32 y) const;
+    // writes the events still in the ring as a Chrome trace
+    bool ExportChromeTrace(const char *path) const;
+
+    // stats of the last EndFrame, nullptr if the marker wasn't recorded yet
+    const MarkerStats *FindMarker(const char *name) const;
+    const CounterStats *FindCounter(const char *name) const;
+
+    bool IsOverlayVisible() const { return m_overlayVisible; }
+    void ToggleOverlay() { m_overlayVisible = !m_overlayVisible; }
+
+    Profiler(const Profiler &other) = delete;
+    Profiler &operator=(const Profiler &other) = delete;
+
+private:
+    enum class EventKind : u8 {
+        Scope,
+        Counter
+    };
+
+    // fields are written before the sequence is published. A reader accepts a slot only if the sequence is
+    // the one it expects before and after reading, so a slot overwritten by a writer wrapping around is skipped
+    struct Slot {
+        std::atomic<u64>            sequence{ 0 };
+        std::atomic<const char *>   name{ nullptr };
+        std::atomic<u64>            start{ 0 };
+        std::atomic<u64>            end{ 0 };
+        std::atomic<u32>            threadId{ 0 };
+        std::atomic<EventKind>      kind{ EventKind::Scope };
+        std::atomic<u64>            value{ 0 };
+    };
+
+    struct Event {
+        const char *    name;
+        u64             start;
+        u64             end;
+        u32             threadId;
+        EventKind       kind;
+        u64             value;
+    };
+
+    Profiler() : m_epoch(std::chrono::steady_clock::now()) {}
+
+    void Write(const char *name, u64 start, u64 end, EventKind kind, u64 value);
+    bool Read(u64 index, Event &event) const;
+    // the address is the common case, the text catches the copies of other modules
+    static bool IsSameName(const char *a, const char *b) { return a == b || strcmp(a, b) == 0; }
+    void AddCounterValue(const Event &event);
+    static u32 GetThreadId();
+
+    std::chrono::steady_clock::time_point   m_epoch;
+    Slot                                    m_slots[MAX_EVENTS];
+    std::atomic<u64>                        m_writeIndex{ 0 };
+    std::atomic<u32>                        m_threadsNum{ 0 };
+    // main thread only
+    u64                                     m_readIndex = 0;
+    u64                                     m_frameStart = 0;
+    f64                                     m_frameMs = 0.0;
+    Buffer<MarkerStats, MAX_MARKERS>        m_markers;
+    Buffer<CounterStats, MAX_COUNTERS>      m_counters;
+    bool                                    m_overlayVisible = false;
+};
+
+class ProfileScope {
+public:
+    explicit ProfileScope(const char *name) : m_name(name), m_start(Profiler::Instance().Now()) {}
+    ~ProfileScope() { Profiler::Instance().Record(m_name, m_start, Profiler::Instance().Now()); }
+
+    ProfileScope(const ProfileScope &other) = delete;
+    ProfileScope &operator=(const ProfileScope &other) = delete;
+
+private:
+    const char *    m_name;
+    u64             m_start;
+};
+
+Profiler &Profiler::Instance() {
+#if HOT_RELOAD_MODULE
+    return *HostInstance<Profiler>::instance;
+#else
+    static Profiler profiler;
+
+    return profiler;
+#endif
+}
+
+u32 Profiler::GetThreadId() {
+    // Chrome trace tids, in order of the first recorded event
+    static thread_local u32 threadId = Instance().m_threadsNum.fetch_add(1, std::memory_order_relaxed);
+
+    return threadId;
+}
+
+void Profiler::Record(const char *name, u64 start, u64 end) {
+    Write(name, start, end, EventKind::Scope, 0);
+}
+
+void Profiler::RecordCounter(const char *name, u64 value) {
+    u64 now = Now();
+    Write(name, now, now, EventKind::Counter, value);
+}
+
+void Profiler::Write(const char *name, u64 start, u64 end, EventKind kind, u64 value) {
+    u64 index = m_writeIndex.fetch_add(1, std::memory_order_relaxed);
+    Slot &slot = m_slots[index & (MAX_EVENTS - 1)];
+
+    slot.name.store(name, std::memory_order_relaxed);
+    slot.start.store(start, std::memory_order_relaxed);
+    slot.end.store(end, std::memory_order_relaxed);
+    slot.threadId.store(GetThreadId(), std::memory_order_relaxed);
+    slot.kind.store(kind, std::memory_order_relaxed);
+    slot.value.store(value, std::memory_order_relaxed);
+    slot.sequence.store(index + 1, std::memory_order_release);
+}
+
+bool Profiler::Read(u64 index, Event &event) const {
+    const Slot &slot = m_slots[index & (MAX_EVENTS - 1)];
+
+    if (slot.sequence.load(std::memory_order_acquire) != index + 1) {
+        return false;
+    }
+
+    event.name = slot.name.load(std::memory_order_relaxed);
+    event.start = slot.start.load(std::memory_order_relaxed);
+    event.end = slot.end.load(std::memory_order_relaxed);
+    event.threadId = slot.threadId.load(std::memory_order_relaxed);
+    event.kind = slot.kind.load(std::memory_order_relaxed);
+    event.value = slot.value.load(std::memory_order_relaxed);
+
+    std::atomic_thread_fence(std::memory_order_acquire);
+
+    return slot.sequence.load(std::memory_order_relaxed) == index + 1;
+}
+
+void Profiler::EndFrame() {
+    u64 now = Now();
+    m_frameMs = (now - m_frameStart) * 1e-6;
+    m_frameStart = now;
+
+    for (u32 i = 0; i < m_markers.len; ++i) {
+        m_markers[i].frameMs = 0.0;
+        m_markers[i].calls = 0;
+    }
+
+    // events which fell out of the ring before this frame got to them are lost
+    u64 writeIndex = m_writeIndex.load(std::memory_order_acquire);
+    if (writeIndex - m_readIndex > MAX_EVENTS) {
+        m_readIndex = writeIndex - MAX_EVENTS;
+    }
+
+    for (; m_readIndex < writeIndex; ++m_readIndex) {
+        Event event;
+        if (!Read(m_readIndex, event)) {
+            // claimed but not published yet, picked up next frame
+            if (m_slots[m_readIndex & (MAX_EVENTS - 1)].sequence.load(std::memory_order_acquire) <= m_readIndex) {
+                break;
+            }
+            continue;
+        }
+
+        if (event.kind == EventKind::Counter) {
+            AddCounterValue(event);
+            continue;
+        }
+
+        int markerIndex = -1;
+        for (u32 i = 0; i < m_markers.len; ++i) {
+            if (IsSameName(m_markers[i].name, event.name)) {
+                markerIndex = static_cast<int>(i);
+                break;
+            }
+        }
+
+        if (markerIndex < 0) {
+            if (m_markers.len == MAX_MARKERS) {
+                continue;
+            }
+            MarkerStats stats = {};
+            stats.name = event.name;
+            markerIndex = m_markers.Add(stats);
+        }
+
+        MarkerStats &stats = m_markers[markerIndex];
+        stats.frameMs += (event.end - event.start) * 1e-6;
+        stats.calls++;
+    }
+
+    for (u32 i = 0; i < m_markers.len; ++i) {
+        MarkerStats &stats = m_markers[i];
+        stats.averageMs += (stats.frameMs - stats.averageMs) * 0.05;
+        stats.maxMs = std::max(stats.maxMs * 0.995, stats.frameMs);
+    }
+
+    for (u32 i = 0; i < m_counters.len; ++i) {
+        CounterStats &stats = m_counters[i];
+        stats.average += (stats.value - stats.average) * 0.05;
+    }
+}
+
+void Profiler::AddCounterValue(const Event &event) {
+    for (u32 i = 0; i < m_counters.len; ++i) {
+        if (IsSameName(m_counters[i].name, event.name)) {
+            m_counters[i].value = event.value;
+            return;
+        }
+    }
+
+    if (m_counters.len == MAX_COUNTERS) {
+        return;
+    }
+
+    CounterStats stats = {};
+    stats.name = event.name;
+    stats.value = event.value;
+    stats.average = (f64)event.value;
+    m_counters.Add(stats);
+}
+
+const Profiler::MarkerStats *Profiler::FindMarker(const char *name) const {
+    for (u32 i = 0; i < m_markers.len; ++i) {
+        if (strcmp(m_markers[i].name, name) == 0) {
+            return &m_markers[i];
+        }
+    }
+
+    return nullptr;
+}
+
+const Profiler::CounterStats *Profiler::FindCounter(const char *name) const {
+    for (u32 i = 0; i < m_counters.len; ++i) {
+        if (strcmp(m_counters[i].name, name) == 0) {
+            return &m_counters[i];
+        }
+    }
+
+    return nullptr;
+}
+
+f32 Profiler::DrawOverlay(f32 x, f32 y) const {
+    if (!m_overlayVisible) {
+        return y;
+    }
+
+    // the default font isn't monospaced, columns get fixed offsets
+    const int fontSize = 20;
+    const int lineHeight = fontSize + 4;
+    const int columns[] = { 8, 220, 310, 400, 490 };
+    const int width = 560;
+    int height = lineHeight * (static_cast<int>(m_markers.len + m_counters.len) + 2) + 8;
+
+    int left = (int)x;
+    int lineY = (int)y + 4;
+    DrawRectangle(left, (int)y, width, height, Fade(BLACK, 0.75f));
+
+    DrawText(TextFormat("frame %.2f ms, F4 exports profile.json", m_frameMs), left + columns[0], lineY, fontSize, WHITE);
+    lineY += lineHeight;
+
+    const char *headers[] = { "marker", "ms", "avg", "max", "calls" };
+    for (int i = 0; i < 5; ++i) {
+        DrawText(headers[i], left + columns[i], lineY, fontSize, GRAY);
+    }
+    lineY += lineHeight;
+
+    for (u32 i = 0; i < m_markers.len; ++i) {
+        const MarkerStats &stats = m_markers[i];
+        // anything taking half a simulation step stands out
+        Color color = stats.frameMs > TIME_STEP * 500.0f ? ORANGE : WHITE;
+        DrawText(stats.name, left + columns[0], lineY, fontSize, color);
+        DrawText(TextFormat("%.3f", stats.frameMs), left + columns[1], lineY, fontSize, color);
+        DrawText(TextFormat("%.3f", stats.averageMs), left + columns[2], lineY, fontSize, color);
+        DrawText(TextFormat("%.3f", stats.maxMs), left + columns[3], lineY, fontSize, color);
+        DrawText(TextFormat("%u", stats.calls), left + columns[4], lineY, fontSize, color);
+        lineY += lineHeight;
+    }
+
+    // the value under ms, the average under avg
+    for (u32 i = 0; i < m_counters.len; ++i) {
+        const CounterStats &stats = m_counters[i];
+        DrawText(stats.name, left + columns[0], lineY, fontSize, SKYBLUE);
+        DrawText(TextFormat("%llu", (unsigned long long)stats.value), left + columns[1], lineY, fontSize, SKYBLUE);
+        DrawText(TextFormat("%.1f", stats.average), left + columns[2], lineY, fontSize, SKYBLUE);
+        lineY += lineHeight;
+    }
+
+    return y + height;
+}
+
+bool Profiler::ExportChromeTrace(const char *path) const {
+    FILE *file = fopen(path, "w");
+    if (!file) {
+        TraceLog(LOG_WARNING, "PROFILER: Failed to write %s", path);
+        return false;
+    }
+
+    u64 writeIndex = m_writeIndex.load(std::memory_order_acquire);
+    u64 first = writeIndex > MAX_EVENTS ? writeIndex - MAX_EVENTS : 0;
+
+    fprintf(file, "{\"traceEvents\":[\n");
+    bool firstEvent = true;
+    for (u64 index = first; index < writeIndex; ++index) {
+        Event event;
+        if (!Read(index, event)) {
+            continue;
+        }
+
+        // complete and counter events, timestamps in microseconds
+        if (event.kind == EventKind::Counter) {
+            fprintf(file, "%s{\"name\":\"%s\",\"ph\":\"C\",\"pid\":0,\"tid\":%u,\"ts\":%.3f,\"args\":{\"value\":%llu}}",
+                firstEvent ? "" : ",\n", event.name, event.threadId, event.start * 1e-3, (unsigned long long)event.value);
+        }
+        else {
+            fprintf(file, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":0,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+                firstEvent ? "" : ",\n", event.name, event.threadId, event.start * 1e-3, (event.end - event.start) * 1e-3);
+        }
+        firstEvent = false;
+    }
+    fprintf(file, "\n],\"displayTimeUnit\":\"ms\"}\n");
+
+    fclose(file);
+
+    TraceLog(LOG_INFO, "PROFILER: Trace written to %s", path);
+
+    return true;
+}
+
+#else
+
+#define PROFILE_SCOPE(name)
+#define PROFILE_COUNTER(name, value) ((void)(value))
+
+#endif
@@ -0,0 +1,276 @@
+#pragma once
+
+#include <raylib.h>
+#include "common.h"
+#include "gamelib.h"
+#include <stdio.h>
+#include <vector>
+
+//NOTE: replays. With the fixed timestep the simulation only depends on the seed and on what Update sees every step,
+// so a session is recorded as exactly that and re-simulated without a window (BreakoutBench --replay). The stream
+// only stores changes: a record is written for the steps where a key went up or down or was pressed, holding the
+// steps since the previous record and the changed keys as varints. Held keys cost nothing, a long session is a few KB.
+// Non-key inputs of the simulation use the slots past the keyboard. Every step folds the game state into a checksum,
+// the recorded one tells whether a replay still plays out the same way.
+
+namespace breakout {
+
+static constexpr u32 REPLAY_FILE_MAGIC = 0x4C505242; // "BRPL"
+static constexpr u16 REPLAY_FILE_VERSION = 1;
+// written by the game on exit, into the working directory
+static constexpr const char *REPLAY_SESSION_FILE = "session.brpl";
+
+// the start menu lets the game start once every asset is uploaded, which depends on the disk and not on the input
+static constexpr int REPLAY_ASSETS_READY = InputState::MAX_KEYS;
+static constexpr int REPLAY_SLOTS_NUM = InputState::MAX_KEYS + 1;
+
+#pragma pack(push, 1)
+struct ReplayFileHeader {
+    u32     magic;
+    u16     version;
+    // steps per second, a replay is only valid for the TIME_STEP it was recorded with
+    u16     tickRate;
+    u32     seed;
+    f32     screenWidth;
+    f32     screenHeight;
+    u32     ticksNum;
+    u64     checksum;
+    // bytes of records following the header
+    u32     dataSize;
+};
+#pragma pack(pop)
+
+static_assert(sizeof(ReplayFileHeader) == 36, "Replay file header layout changed");
+
+// a parsed replay, records point into the file's memory
+struct ReplayData {
+    u32         seed = 0;
+    Vector2     screenSize = {};
+    u32         ticksNum = 0;
+    u64         checksum = 0;
+    const u8 *  records = nullptr;
+    u32         recordsSize = 0;
+};
+
+class ReplayRecorder {
+public:
+    // a ten minute session takes a few KB, steps don't allocate while the game is played
+    static constexpr size_t RESERVED_BYTES = 256 * 1024;
+
+    void Start(u32 seed);
+    bool IsRecording() const { return m_recording; }
+    // input Update is about to step with
+    void RecordTick(const InputState &input, bool assetsReady);
+    // checksum of the state after the last recorded step
+    bool Save(const char *path, u64 checksum) const;
+
+private:
+    void WriteVarint(u32 value);
+
+    std::vector<u8>     m_data;
+    bool                m_down[REPLAY_SLOTS_NUM] = {};
+    u32                 m_seed = 0;
+    u32                 m_ticksNum = 0;
+    u32                 m_lastRecordTick = 0;
+    bool                m_recording = false;
+};
+
+class ReplayPlayer {
+public:
+    void Init(const ReplayData &replay);
+    // applies the changes of the next step to input and assetsReady, false once every recorded step was played.
+    // input must be consumed between steps, Update does it
+    bool NextTick(InputState &input, bool &assetsReady);
+    u32 GetTick() const { return m_tick; }
+
+private:
+    bool ReadVarint(u32 &value);
+
+    ReplayData  m_replay;
+    u32         m_offset = 0;
+    u32         m_tick = 0;
+    u32         m_nextRecordTick = 0;
+    bool        m_hasRecord = false;
+};
+
+// validates the header and the record size against the file size
+bool ParseReplay(const u8 *data, size_t size, ReplayData &replay);
+
+void ReplayRecorder::Start(u32 seed) {
+    m_data.clear();
+    m_data.reserve(RESERVED_BYTES);
+    memset(m_down, 0, sizeof(m_down));
+    m_seed = seed;
+    m_ticksNum = 0;
+    m_lastRecordTick = 0;
+    m_recording = true;
+}
+
+void ReplayRecorder::WriteVarint(u32 value) {
+    while (value >= 0x80) {
+        m_data.push_back(static_cast<u8>(value | 0x80));
+        value >>= 7;
+    }
+    m_data.push_back(static_cast<u8>(value));
+}
+
+void ReplayRecorder::RecordTick(const InputState &input, bool assetsReady) {
+    assert(m_recording);
+
+    // the keys are compared twice, a step without changes must not write anything and the count comes first
+    u32 changesNum = 0;
+    for (int key = 0; key < InputState::MAX_KEYS; ++key) {
+        changesNum += input.down[key] != m_down[key] || input.pressed[key];
+    }
+    changesNum += assetsReady != m_down[REPLAY_ASSETS_READY];
+
+    if (changesNum > 0) {
+        WriteVarint(m_ticksNum - m_lastRecordTick);
+        WriteVarint(changesNum);
+
+        // slot << 2 | down << 1 | pressed
+        for (int key = 0; key < InputState::MAX_KEYS; ++key) {
+            if (input.down[key] != m_down[key] || input.pressed[key]) {
+                WriteVarint(static_cast<u32>(key) << 2 | (u32)input.down[key] << 1 | (u32)input.pressed[key]);
+                m_down[key] = input.down[key];
+            }
+        }
+        if (assetsReady != m_down[REPLAY_ASSETS_READY]) {
+            WriteVarint(static_cast<u32>(REPLAY_ASSETS_READY) << 2 | (u32)assetsReady << 1);
+            m_down[REPLAY_ASSETS_READY] = assetsReady;
+        }
+
+        m_lastRecordTick = m_ticksNum;
+    }
+
+    m_ticksNum++;
+}
+
+bool ReplayRecorder::Save(const char *path, u64 checksum) const {
+    FILE *file = fopen(path, "wb");
+    if (!file) {
+        TraceLog(LOG_WARNING, "REPLAY: Failed to write %s", path);
+        return false;
+    }
+
+    ReplayFileHeader header = {};
+    header.magic = REPLAY_FILE_MAGIC;
+    header.version = REPLAY_FILE_VERSION;
+    header.tickRate = static_cast<u16>(TARGET_FPS);
+    header.seed = m_seed;
+    header.screenWidth = globals::appSettings.screenWidth;
+    header.screenHeight = globals::appSettings.screenHeight;
+    header.ticksNum = m_ticksNum;
+    header.checksum = checksum;
+    header.dataSize = static_cast<u32>(m_data.size());
+
+    bool written = fwrite(&header, sizeof(header), 1, file) == 1;
+    if (!m_data.empty()) {
+        written = written && fwrite(m_data.data(), m_data.size(), 1, file) == 1;
+    }
+    fclose(file);
+
+    if (!written) {
+        TraceLog(LOG_WARNING, "REPLAY: Failed to write %s", path);
+        return false;
+    }
+
+    TraceLog(LOG_INFO, "REPLAY: %u steps written to %s (%u bytes)", m_ticksNum, path, (u32)(sizeof(header) + m_data.size()));
+
+    return true;
+}
+
+bool ParseReplay(const u8 *data, size_t size, ReplayData &replay) {
+    if (size < sizeof(ReplayFileHeader)) {
+        return false;
+    }
+
+    ReplayFileHeader header;
+    memcpy(&header, data, sizeof(header));
+    if (header.magic != REPLAY_FILE_MAGIC || header.version != REPLAY_FILE_VERSION) {
+        return false;
+    }
+
+    if (header.tickRate != TARGET_FPS || header.dataSize > size - sizeof(ReplayFileHeader)) {
+        return false;
+    }
+
+    replay.seed = header.seed;
+    replay.screenSize = Vector2{ header.screenWidth, header.screenHeight };
+    replay.ticksNum = header.ticksNum;
+    replay.checksum = header.checksum;
+    replay.records = data + sizeof(ReplayFileHeader);
+    replay.recordsSize = header.dataSize;
+
+    return true;
+}
+
+void ReplayPlayer::Init(const ReplayData &replay) {
+    m_replay = replay;
+    m_offset = 0;
+    m_tick = 0;
+
+    u32 delta = 0;
+    m_hasRecord = ReadVarint(delta);
+    m_nextRecordTick = delta;
+}
+
+bool ReplayPlayer::ReadVarint(u32 &value) {
+    value = 0;
+    for (u32 shift = 0; shift < 32; shift += 7) {
+        if (m_offset >= m_replay.recordsSize) {
+            return false;
+        }
+        u8 byte = m_replay.records[m_offset++];
+        value |= static_cast<u32>(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool ReplayPlayer::NextTick(InputState &input, bool &assetsReady) {
+    if (m_tick >= m_replay.ticksNum) {
+        return false;
+    }
+
+    // the recorder starts from assets not ready, whatever the replaying Initialize found. A ready state shows up
+    // as a change in the first step
+    if (m_tick == 0) {
+        assetsReady = false;
+    }
+
+    if (m_hasRecord && m_tick == m_nextRecordTick) {
+        u32 changesNum = 0;
+        ReadVarint(changesNum);
+
+        for (u32 i = 0; i < changesNum; ++i) {
+            u32 change = 0;
+            if (!ReadVarint(change)) {
+                break;
+            }
+
+            u32 slot = change >> 2;
+            bool down = (change & 2) != 0;
+            if (slot == REPLAY_ASSETS_READY) {
+                assetsReady = down;
+            }
+            else if (slot < InputState::MAX_KEYS) {
+                input.down[slot] = down;
+                input.pressed[slot] = (change & 1) != 0;
+            }
+        }
+
+        u32 delta = 0;
+        m_hasRecord = ReadVarint(delta);
+        m_nextRecordTick = m_tick + delta;
+    }
+
+    m_tick++;
+
+    return true;
+}
+
+}
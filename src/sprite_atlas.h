@@ -0,0 +1,40 @@
+#pragma once
+
+// generated by AtlasPacker from assets/atlas.txt, don't edit
+
+namespace breakout {
+
+enum class SpriteId : u16 {
+    Player,
+    Block,
+    Ball,
+    Portal,
+    Alien0,
+    Alien1,
+    Alien2,
+    Alien3,
+    Count
+};
+
+static constexpr const char *SPRITE_ATLAS_FILE = "assets/atlas.png";
+static constexpr int SPRITE_ATLAS_WIDTH = 256;
+static constexpr int SPRITE_ATLAS_HEIGHT = 512;
+
+static constexpr Rectangle SPRITE_RECTS[] = {
+    { 31, 366, 16, 16 },
+    { 2, 366, 25, 25 },
+    { 2, 2, 222, 256 },
+    { 2, 262, 100, 100 },
+    { 106, 262, 64, 64 },
+    { 174, 262, 64, 64 },
+    { 106, 330, 64, 64 },
+    { 174, 330, 64, 64 },
+};
+
+static_assert(sizeof(SPRITE_RECTS) / sizeof(SPRITE_RECTS[0]) == static_cast<size_t>(SpriteId::Count), "Sprite table is out of date");
+
+constexpr Rectangle GetSpriteRect(SpriteId id) {
+    return SPRITE_RECTS[static_cast<int>(id)];
+}
+
+}